@@ -15,21 +15,42 @@
 //
 
 #include <stdio.h>
-#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cpu.h"
+#include "input.h"
+#include "petscii.h"
+#include "disasm.h"
+#include "profile.h"
+#include "stats.h"
 
 #define CFLAG(X,Y) ((X) >= (Y)         ? 1:0)
 #define ZFLAG(X)   ((X) == 0           ? 1:0)
 #define NFLAG(X)   (((X) & 0b10000000) ? 1:0)
-#define STACKBASE 0x0100
 
 // not gcc? try this
 //#define NFLAG(X) (((X) & ((uint8_t) 128)) ? 1:0)
 
 struct Tcpu cpu;
-uint8_t mem[0xFFFF];
+double      cpu_freq;
+uint32_t    cpu_frame;
+
+_Static_assert (sizeof (struct Tcpu) == 64, "the registers fit a cache line");
+// page aligned, a forked machine shares memory with its parent until written (see state_fork)
+uint8_t mem[CPU_MEMSIZE] __attribute__ ((aligned (4096)));
+
+struct cpu_rom cpu_roms[CPU_MAXROM];
+int            cpu_nroms;
+
+uint8_t mem_dirty[CPU_MEMSIZE >> 8];
+uint8_t mem_rom[CPU_MEMSIZE >> 8];
 
 // vic http://www.zimmers.net/cbmpics/cbm/c64/vic-ii.txt
 
@@ -42,380 +63,655 @@ uint8_t mem[0xFFFF];
 // https://amaus.net/static/S100/commodore/brochure/The%20Complete%20Commodore%20Inner%20Space%20Anthology.pdf
 // https://wiki.nesdev.com/w/index.php/Emulator_tests
 
-struct isa_t {
-    char opcode[3];
-    uint8_t ist_len;
-    uint8_t pc_step;
-    uint8_t clock;
-    void (*f)();
-} ISA[];
 
-// 0..31
-const char PETSCII[255] = { ' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',
-                            ' ','!',' ',' ',' ',' ',' ',' ','<','>','*',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',
-                            '@','A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P','Q','R','S','T','U','V','W','X','Y','Z',' ',' ',' ',' ',' ',
-                            ' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',
-                            ' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',
-                            ' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' ',' '                                                                                    
-                           };        
+// bus cycles
+// a handler is the bus cycles of an istruction after the opcode fetch (T0),
+// one case each from T1 on. the cycle core calls it once per cycle ('one' set,
+// cpu.tcycle is the case to go on with), the fast core once per istruction and
+// it falls through every case: the same reads and writes on the same cycles
+// either way. cpu.ea / ptr / data / carry hold what a cycle leaves to the next.
+// dummy reads of the istruction stream, the stack and page 0 have no effect
+// and are left out. the ones at a data address (indexed, high byte not fixed
+// yet) and the dummy write of a read-modify-write are done
+// https://www.nesdev.org/6502_cpu.txt
+
+// end of a cycle, case n is the next one
+#define NEXT(n)                 \
+    cpu.cycle++;                \
+    if (one) {                  \
+        cpu.tcycle = (n);       \
+        return;                 \
+    }                           \
+    __attribute__ ((fallthrough))
 
-static inline int8_t
-REL2ABS (uint8_t address)
+// end of the last one
+#define DONE                    \
+    cpu.cycle++;                \
+    cpu.tcycle = 0;             \
+    return
+
+#define CPU_STEPS static inline __attribute__ ((always_inline)) void
+
+// operand byte n, PC is still the opcode's
+static inline uint8_t
+cpu_arg (int n)
 {
-    return (NFLAG (address)? -((address ^ 0xFF)+1):address);
+    return mem[(uint16_t)(cpu.PC + n)];
 }
 
-// debug
-// simple video dump @$0400
-void debug_videodump(void)
+// interrupts are polled going into the last cycle of an istruction, on the line
+// as the cycle before left it: the cycle core sees a device raise it between
+// any two cycles, the fast core between istructions
+static inline void
+cpu_poll (void)
 {
-    printf("Dumping video\n");
-    for (int l=0; l<24; l++) {    
-        for (int c=0; c<40; c++) {
-            char chr =  PETSCII[mem[0x0400 + c + l * 40]];
-            printf("%c", chr);
-            //printf("%i ", mem[0x0400 + c + l * 40]);
-        }
-        printf("\n");
-    }
-    printf("Dumped!\n");
+    cpu.intr = (cpu.irq && !cpu.P.I ? CPU_INTR_PENDING : 0);
 }
 
-void 
-cpu_ADC_IMM (void)
+// the index goes on the low byte first, carry tells the high byte is still to
+// fix: on a page cross the 6510 reads at ea - 0x100 and spends a cycle on it.
+// a load pays it only when crossing, a store always does the dummy read
+static inline void
+cpu_index (uint8_t index)
 {
-    uint16_t tot = cpu.A + mem[cpu.PC+1] + cpu.P.C;
-    int16_t vtot = (int8_t)cpu.A + (int8_t)mem[cpu.PC+1] + cpu.P.C; 
+    uint16_t ea = cpu.ea + index;
 
-    cpu.A = tot & 0x00FF;
+    cpu.carry = ((cpu.ea ^ ea) > 0xFF);
+    cpu.ea    = ea;
+}
 
-    cpu.P.N = NFLAG (cpu.A);
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.C = (tot>0x00FF ? 1:0);    
-    cpu.P.V = (vtot < -128 || vtot > 127);
+#define AM_UNFIXED (uint16_t)(cpu.ea - (cpu.carry << 8))
 
-}
+typedef void    (*cpu_rd_f)  (uint8_t value);
+typedef uint8_t (*cpu_wr_f)  (void);
+typedef uint8_t (*cpu_rmw_f) (uint8_t value);
+typedef void    (*cpu_reg_f) (void);
 
-void 
-cpu_AND_IMM (void)
-{
-    cpu.A = cpu.A & mem[cpu.PC+1];
-    cpu.P.N = NFLAG (cpu.A);
-    cpu.P.Z = ZFLAG (cpu.A);
-}
+// loads: the operation gets the byte on the last cycle
 
-void 
-cpu_AND_ZEROX (void)
+CPU_STEPS
+cpu_rdIMM (int one, cpu_rd_f f)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    (void)one;
 
-    cpu.A = cpu.A & mem[addr.addr + cpu.X];
+    cpu_poll ();
+    f (cpu_arg (1));
+    DONE;
+}
 
-    cpu.P.N = NFLAG (cpu.A);
-    cpu.P.Z = ZFLAG (cpu.A);
+CPU_STEPS
+cpu_rdZP (int one, cpu_rd_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu_poll ();
+        f (cpu_read (cpu.ea));
+        DONE;
+    }
+}
 
+// zero page indexed wraps inside page 0
+CPU_STEPS
+cpu_rdZPI (int one, cpu_rd_f f, uint8_t index)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea = (uint8_t)(cpu.ea + index);
+        NEXT (3);
+    case 3:
+        cpu_poll ();
+        f (cpu_read (cpu.ea));
+        DONE;
+    }
 }
 
-void 
-cpu_ASL (void)
+CPU_STEPS
+cpu_rdZPX (int one, cpu_rd_f f)
 {
-    cpu.P.C = ((cpu.A & 0b10000000) == 0 ? 0:1);
-    cpu.A = cpu.A << 1;
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    cpu_rdZPI (one, f, cpu.X);
 }
 
-void
-cpu_BCC (void)
+CPU_STEPS
+cpu_rdZPY (int one, cpu_rd_f f)
 {
-    if (cpu.P.C == 0) {
-        // jump relative
-        cpu.cycle++; 
-
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
-
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+    cpu_rdZPI (one, f, cpu.Y);
+}
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+CPU_STEPS
+cpu_rdABS (int one, cpu_rd_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        NEXT (3);
+    case 3:
+        cpu_poll ();
+        f (cpu_read (cpu.ea));
+        DONE;
+    }
+}
 
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
+CPU_STEPS
+cpu_rdABSI (int one, cpu_rd_f f, uint8_t index)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        cpu_index (index);
+        NEXT (3);
+    case 3:
+        if (!cpu.carry) {
+            cpu_poll ();
+            f (cpu_read (cpu.ea));
+            DONE;
         }
+        cpu_read (AM_UNFIXED);
+        NEXT (4);
+    case 4:
+        cpu_poll ();
+        f (cpu_read (cpu.ea));
+        DONE;
     }
 }
 
-void
-cpu_BCS (void)
+CPU_STEPS
+cpu_rdABSX (int one, cpu_rd_f f)
 {
-    if (cpu.P.C == 1) {
-        // jump relative
-        cpu.cycle++;
-
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+    cpu_rdABSI (one, f, cpu.X);
+}
 
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+CPU_STEPS
+cpu_rdABSY (int one, cpu_rd_f f)
+{
+    cpu_rdABSI (one, f, cpu.Y);
+}
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+// ($nn,X), the pointer wraps inside page 0
+CPU_STEPS
+cpu_rdINDX (int one, cpu_rd_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ptr = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ptr += cpu.X;
+        NEXT (3);
+    case 3:
+        cpu.ea = cpu_read (cpu.ptr);
+        NEXT (4);
+    case 4:
+        cpu.ea |= cpu_read ((uint8_t)(cpu.ptr + 1)) << 8;
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        f (cpu_read (cpu.ea));
+        DONE;
+    }
+}
 
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
+// ($nn),Y
+CPU_STEPS
+cpu_rdINDY (int one, cpu_rd_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ptr = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea = cpu_read (cpu.ptr);
+        NEXT (3);
+    case 3:
+        cpu.ea |= cpu_read ((uint8_t)(cpu.ptr + 1)) << 8;
+        cpu_index (cpu.Y);
+        NEXT (4);
+    case 4:
+        if (!cpu.carry) {
+            cpu_poll ();
+            f (cpu_read (cpu.ea));
+            DONE;
         }
-
+        cpu_read (AM_UNFIXED);
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        f (cpu_read (cpu.ea));
+        DONE;
     }
 }
 
-void
-cpu_BEQ (void)
-{
-    // FIXME ALL cycle
-    if (cpu.P.Z == 1) {
-        // jump relative
-        cpu.cycle++; 
-
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
-        
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
-
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+// stores: the operation gives the byte, written on the last cycle
 
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
-        }
+CPU_STEPS
+cpu_wrZP (int one, cpu_wr_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu_poll ();
+        cpu_write (cpu.ea, f ());
+        DONE;
+    }
+}
 
+CPU_STEPS
+cpu_wrZPI (int one, cpu_wr_f f, uint8_t index)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea = (uint8_t)(cpu.ea + index);
+        NEXT (3);
+    case 3:
+        cpu_poll ();
+        cpu_write (cpu.ea, f ());
+        DONE;
     }
 }
 
-void
-cpu_BIT_ZERO (void)
+CPU_STEPS
+cpu_wrZPX (int one, cpu_wr_f f)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    cpu_wrZPI (one, f, cpu.X);
+}
 
-    cpu.P.Z = ZFLAG (cpu.A & mem[addr.addr]);
-    cpu.P.N = ((mem[addr.addr] & 0b10000000) == 0 ? 0:1);
-    cpu.P.V = ((mem[addr.addr] & 0b01000000) == 0 ? 0:1);
-                
+CPU_STEPS
+cpu_wrZPY (int one, cpu_wr_f f)
+{
+    cpu_wrZPI (one, f, cpu.Y);
 }
 
-void 
-cpu_BNE (void)
+CPU_STEPS
+cpu_wrABS (int one, cpu_wr_f f)
 {
-    if (cpu.P.Z == 0) {
-        // jump relative
-        cpu.cycle++; 
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        NEXT (3);
+    case 3:
+        cpu_poll ();
+        cpu_write (cpu.ea, f ());
+        DONE;
+    }
+}
 
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+CPU_STEPS
+cpu_wrABSI (int one, cpu_wr_f f, uint8_t index)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        cpu_index (index);
+        NEXT (3);
+    case 3:
+        cpu_read (AM_UNFIXED);
+        NEXT (4);
+    case 4:
+        cpu_poll ();
+        cpu_write (cpu.ea, f ());
+        DONE;
+    }
+}
 
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+CPU_STEPS
+cpu_wrABSX (int one, cpu_wr_f f)
+{
+    cpu_wrABSI (one, f, cpu.X);
+}
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+CPU_STEPS
+cpu_wrABSY (int one, cpu_wr_f f)
+{
+    cpu_wrABSI (one, f, cpu.Y);
+}
 
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
-        }
+CPU_STEPS
+cpu_wrINDX (int one, cpu_wr_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ptr = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ptr += cpu.X;
+        NEXT (3);
+    case 3:
+        cpu.ea = cpu_read (cpu.ptr);
+        NEXT (4);
+    case 4:
+        cpu.ea |= cpu_read ((uint8_t)(cpu.ptr + 1)) << 8;
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu_write (cpu.ea, f ());
+        DONE;
     }
 }
 
-void
-cpu_BPL (void)
-{
-    if (cpu.P.N == 0 ) {
-        // jump relative
-        cpu.cycle++; 
+CPU_STEPS
+cpu_wrINDY (int one, cpu_wr_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ptr = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea = cpu_read (cpu.ptr);
+        NEXT (3);
+    case 3:
+        cpu.ea |= cpu_read ((uint8_t)(cpu.ptr + 1)) << 8;
+        cpu_index (cpu.Y);
+        NEXT (4);
+    case 4:
+        cpu_read (AM_UNFIXED);
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu_write (cpu.ea, f ());
+        DONE;
+    }
+}
 
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+// read-modify-write: read, write the byte back as it was while the operation
+// works on it, write the result
+
+CPU_STEPS
+cpu_rmwZP (int one, cpu_rmw_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.data = cpu_read (cpu.ea);
+        NEXT (3);
+    case 3:
+        cpu_write (cpu.ea, cpu.data);
+        cpu.data = f (cpu.data);
+        NEXT (4);
+    case 4:
+        cpu_poll ();
+        cpu_write (cpu.ea, cpu.data);
+        DONE;
+    }
+}
 
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+CPU_STEPS
+cpu_rmwZPX (int one, cpu_rmw_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea = (uint8_t)(cpu.ea + cpu.X);
+        NEXT (3);
+    case 3:
+        cpu.data = cpu_read (cpu.ea);
+        NEXT (4);
+    case 4:
+        cpu_write (cpu.ea, cpu.data);
+        cpu.data = f (cpu.data);
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu_write (cpu.ea, cpu.data);
+        DONE;
+    }
+}
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+CPU_STEPS
+cpu_rmwABS (int one, cpu_rmw_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        NEXT (3);
+    case 3:
+        cpu.data = cpu_read (cpu.ea);
+        NEXT (4);
+    case 4:
+        cpu_write (cpu.ea, cpu.data);
+        cpu.data = f (cpu.data);
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu_write (cpu.ea, cpu.data);
+        DONE;
+    }
+}
 
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
-        }
+CPU_STEPS
+cpu_rmwABSX (int one, cpu_rmw_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        cpu_index (cpu.X);
+        NEXT (3);
+    case 3:
+        cpu_read (AM_UNFIXED);
+        NEXT (4);
+    case 4:
+        cpu.data = cpu_read (cpu.ea);
+        NEXT (5);
+    case 5:
+        cpu_write (cpu.ea, cpu.data);
+        cpu.data = f (cpu.data);
+        NEXT (6);
+    case 6:
+        cpu_poll ();
+        cpu_write (cpu.ea, cpu.data);
+        DONE;
     }
 }
 
-void 
-cpu_BMI (void) {
-    if (cpu.P.N == 1 ) {
-        // jump relative
-        cpu.cycle++; 
+// implied and accumulator, two cycles
+CPU_STEPS
+cpu_reg (int one, cpu_reg_f f)
+{
+    (void)one;
 
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
-        
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+    cpu_poll ();
+    f ();
+    DONE;
+}
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
-        
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
-        }
+// PHA PHP: a cycle on the stack, the push
+CPU_STEPS
+cpu_psh (int one, cpu_wr_f f)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        NEXT (2);
+    case 2:
+        cpu_poll ();
+        cpu_push (f ());
+        DONE;
     }
 }
 
-void
-cpu_BRK (void)
+// PLA PLP: two cycles on the stack, the pull
+CPU_STEPS
+cpu_pul (int one, cpu_rd_f f)
 {
-	cpu_FIXME ("BRK: softirq not implemented"); // softirq pls
+    switch (cpu.tcycle) {
+    case 1:
+        NEXT (2);
+    case 2:
+        NEXT (3);
+    case 3:
+        cpu_poll ();
+        f (cpu_pull ());
+        DONE;
+    }
+}
+
 
-	cpu.P.I = 1;	
-	cpu.P.B = 1;
+// debug
+// video dump @(HIBASE)
+void debug_videodump(void)
+{
+    static char text[PETSCII_SCREEN_MAX];
 
-	// FIXME: raise softirq here
+    petscii_screen (text, sizeof (text));
+    printf("Dumping video\n%sDumped!\n", text);
 }
 
-void
-cpu_BVC (void)
+// operations
+
+// decimal mode as the nmos part does it: Z from the binary sum, N and V from
+// the high digit before its fix up. http://www.6502.org/tutorials/decimal_mode.html
+static inline void
+cpu_ADC (uint8_t value)
 {
-    if (cpu.P.V == 0) {
-        // jump relative
-        cpu.cycle++;
+    uint16_t tot = cpu.A + value + cpu.P.C;
+    int16_t vtot = (int8_t)cpu.A + (int8_t)value + cpu.P.C;
 
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+    if (cpu.P.D) {
+        int lo = (cpu.A & 0x0F) + (value & 0x0F) + cpu.P.C;
+        int hi = (cpu.A >> 4) + (value >> 4) + (lo > 9);
 
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+        if (lo > 9) lo += 6;
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
-        
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
-        }
+        cpu.P.Z = ZFLAG (tot & 0xFF);
+        cpu.P.N = (hi >> 3) & 1;
+        cpu.P.V = (((hi << 4) ^ cpu.A) & 0x80) && !((cpu.A ^ value) & 0x80);
 
+        if (hi > 9) hi += 6;
+        cpu.P.C = (hi > 0x0F);
+        cpu.A   = (hi << 4) | (lo & 0x0F);
+        return;
     }
+
+    cpu.A = tot & 0x00FF;
+
+    cpu.P.N = NFLAG (cpu.A);
+    cpu.P.Z = ZFLAG (cpu.A);
+    cpu.P.C = (tot>0x00FF ? 1:0);
+    cpu.P.V = (vtot < -128 || vtot > 127);
+
 }
 
-void
-cpu_BVS (void)
+static inline void
+cpu_AND (uint8_t value)
 {
-    if (cpu.P.V == 1) {
-        // jump relative
-        cpu.cycle++;
-
-        union cpu_addr oldaddr;
-        oldaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+    cpu.A = cpu.A & value;
+    cpu.P.N = NFLAG (cpu.A);
+    cpu.P.Z = ZFLAG (cpu.A);
+}
 
-        cpu.PC += REL2ABS (mem[cpu.PC+1]);
+static inline uint8_t
+cpu_ASL (uint8_t value)
+{
+    cpu.P.C = ((value & 0b10000000) == 0 ? 0:1);
+    value = value << 1;
+    cpu.P.Z = ZFLAG (value);
+    cpu.P.N = NFLAG (value);
+    return value;
+}
 
-        union cpu_addr newaddr;
-        newaddr.addr = cpu.PC + ISA[cpu.IR].ist_len; // ist len
+static inline void
+cpu_ASL_A (void)
+{
+    cpu.A = cpu_ASL (cpu.A);
+}
 
-        if (newaddr.addrH != oldaddr.addrH) {
-            cpu.cycle++; 
-        }
-    }
+static inline void
+cpu_BIT (uint8_t value)
+{
+    cpu.P.Z = ZFLAG (cpu.A & value);
+    cpu.P.N = ((value & 0b10000000) == 0 ? 0:1);
+    cpu.P.V = ((value & 0b01000000) == 0 ? 0:1);
 }
 
-void
+static inline void
 cpu_CLC (void)
 {
     cpu.P.C = 0;
 }
 
-void
+static inline void
 cpu_CLD (void)
 {
     cpu.P.D = 0;
 }
 
-void
+static inline void
 cpu_CLI (void)
 {
     cpu.P.I = 0;
 }
 
-void
+static inline void
 cpu_CLV (void)
 {
-    cpu.P.V = 0;   
+    cpu.P.V = 0;
 }
 
-
-void
-cpu_CMP_ABS_X (void)
+static inline void
+cpu_CMP (uint8_t value)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
-    
-    uint8_t oldAddrH = addr.addrH;
-    addr.addr += cpu.X;
-
-    uint8_t value = mem[addr.addr];
-
     cpu.P.C = CFLAG (cpu.A , value);
     cpu.P.Z = ZFLAG (cpu.A - value);
     cpu.P.N = NFLAG (cpu.A - value);
-
-    if (addr.addrH != oldAddrH) {
-        cpu.cycle++;
-    }
-
 }
 
-void
-cpu_CMP_IMM (void)
+static inline void
+cpu_CPX (uint8_t value)
 {
-    uint8_t value = mem[cpu.PC+1];
-
-    cpu.P.C = CFLAG (cpu.A , value);
-    cpu.P.Z = ZFLAG (cpu.A - value);
-    cpu.P.N = NFLAG (cpu.A - value);
-}
-
-void
-cpu_CMP_IND_Y (void)
-{
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
-
-    uint8_t value = mem[addr.addr] + cpu.Y;
-
-    cpu.P.C = CFLAG (cpu.A , value);
-    cpu.P.Z = ZFLAG (cpu.A - value);
-    cpu.P.N = NFLAG (cpu.A - value);
-
-    cpu_FIXME ("CMP_IND_Y: add 1 to cycles if page boundery is crossed");
-}
-
-void
-cpu_CPX_IMM (void)
-{
-    uint8_t value = mem[cpu.PC+1];
-
     cpu.P.C = CFLAG (cpu.X , value);
     cpu.P.Z = ZFLAG (cpu.X - value);
     cpu.P.N = NFLAG (cpu.X - value);
 }
 
-void
-cpu_CPY_IMM (void)
+static inline void
+cpu_CPY (uint8_t value)
 {
-    uint8_t value = mem[cpu.PC+1];
-
     cpu.P.C = CFLAG (cpu.Y , value);
     cpu.P.Z = ZFLAG (cpu.Y - value);
     cpu.P.N = NFLAG (cpu.Y - value);
 }
 
-void
+static inline uint8_t
+cpu_DEC (uint8_t value)
+{
+    value--;
+
+    cpu.P.Z = ZFLAG (value);
+    cpu.P.N = NFLAG (value);
+    return value;
+}
+
+static inline void
 cpu_DEX (void)
 {
     cpu.X--;
@@ -423,7 +719,7 @@ cpu_DEX (void)
     cpu.P.N = NFLAG (cpu.X);
 }
 
-void
+static inline void
 cpu_DEY (void)
 {
     cpu.Y--;
@@ -431,31 +727,26 @@ cpu_DEY (void)
     cpu.P.N = NFLAG (cpu.Y);
 }
 
-void
-cpu_EOR_IMM (void)
+static inline void
+cpu_EOR (uint8_t value)
 {
-    uint8_t value = mem[cpu.PC+1];
     cpu.A = cpu.A ^ value;
 
     cpu.P.Z = ZFLAG (cpu.A);
     cpu.P.N = NFLAG (cpu.A);
 }
 
-void
-cpu_INC_ZERO (void)
+static inline uint8_t
+cpu_INC (uint8_t value)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
-    
-    ++mem[addr.addr];
-
-    cpu.P.Z = ZFLAG (mem[addr.addr]);
-    cpu.P.N = NFLAG (mem[addr.addr]);
+    value++;
 
+    cpu.P.Z = ZFLAG (value);
+    cpu.P.N = NFLAG (value);
+    return value;
 }
 
-void
+static inline void
 cpu_INX (void)
 {
     ++cpu.X;
@@ -463,7 +754,7 @@ cpu_INX (void)
     cpu.P.N = NFLAG (cpu.X);
 }
 
-void
+static inline void
 cpu_INY (void)
 {
     ++cpu.Y;
@@ -471,1017 +762,1131 @@ cpu_INY (void)
     cpu.P.N = NFLAG (cpu.Y);
 }
 
-void
-cpu_JSR (void)
+static inline void
+cpu_LDA (uint8_t value)
 {
-    uint8_t opl = mem[cpu.PC+1];
-    uint8_t oph = mem[cpu.PC+2];
-
-    cpu.PC += 2;
-    mem[STACKBASE + cpu.SP] = cpu.PCH;
-    cpu.SP--;
-    mem[STACKBASE + cpu.SP] = cpu.PCL;
-    cpu.SP--;
-    
-    cpu.PCL = opl;
-    cpu.PCH = oph;
+    cpu.A = value;
+    cpu.P.Z = ZFLAG (cpu.A);
+    cpu.P.N = NFLAG (cpu.A);
 }
 
-void
-cpu_JMP_ABS (void)
+static inline void
+cpu_LDX (uint8_t value)
 {
-    uint8_t opl = mem[cpu.PC+1];
-    uint8_t oph = mem[cpu.PC+2];
-
-    cpu.PCL = opl;
-    cpu.PCH = oph;
+    cpu.X = value;
+    cpu.P.Z = ZFLAG (cpu.X);
+    cpu.P.N = NFLAG (cpu.X);
 }
 
-
-void
-cpu_JMP_IND (void)
+static inline void
+cpu_LDY (uint8_t value)
 {
-
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
-
-    cpu.PCL = mem[addr.addr];
-    cpu.PCH = mem[addr.addr+1];
-
+    cpu.Y = value;
+    cpu.P.Z = ZFLAG (cpu.Y);
+    cpu.P.N = NFLAG (cpu.Y);
 }
 
-
-void
-cpu_LDA_ABS (void) 
+static inline uint8_t
+cpu_LSR (uint8_t value)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2]; 
-    //printf ("PC1 %0x PC2 %0x\n", mem[cpu.PC+1], mem[cpu.PC+2]);
-    //printf ("PC3 %0x  %0x\n", addr.addr , mem[addr.addr]);
-
-    cpu.A = mem[addr.addr]; 
-
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    cpu.P.C = value & 0b00000001;
+    value = value >> 1;
+    cpu.P.Z = ZFLAG (value);
+    cpu.P.N = 0;
+    return value;
 }
 
-void
-cpu_LDA_ABS_X (void)
+static inline void
+cpu_LSR_A (void)
 {
-    union cpu_addr addr;
-    
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2]; 
-    uint8_t oldAddrH = addr.addrH;
-
-    addr.addr += cpu.X;
-
-    cpu.A = mem[addr.addr]; 
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
- 
-    //cpu_FIXME ("LDA_ABS_X: add 1 to cycles if page boundery is crossed");
-    if (addr.addrH !=  oldAddrH) {
-        cpu.cycle++;
-    }
+    cpu.A = cpu_LSR (cpu.A);
 }
 
-void
-cpu_LDA_ABS_Y (void)
+static inline void
+cpu_NOP (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2]; 
-    addr.addr += cpu.Y;
-
-    cpu.A = mem[addr.addr]; 
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
-    // FIXME: compute the exact cpu cycl count (page cross)
-    cpu_FIXME ("LDA_ABS_Y: add 1 to cycles if page boundery is crossed");
-
 }
 
-void
-cpu_LDA_IMM (void)
+static inline void
+cpu_ORA (uint8_t value)
 {
-    cpu.A = mem[cpu.PC+1];
+    cpu.A = cpu.A | value;
     cpu.P.Z = ZFLAG (cpu.A);
     cpu.P.N = NFLAG (cpu.A);
 }
 
-void
-cpu_LDA_IND_X (void)
+static inline uint8_t
+cpu_PHP (void)
 {
-    /*
-    FA7  A9 00     LDA #$00                        A:00 X:55 Y:69 P:27 SP:FB PPU:267, 21 CYC:2483
-    CFA9  85 80     STA $80 = 00                    A:00 X:55 Y:69 P:27 SP:FB PPU:273, 21 CYC:2485
-    CFAB  A9 02     LDA #$02                        A:00 X:55 Y:69 P:27 SP:FB PPU:282, 21 CYC:2488
-    CFAD  85 81     STA $81 = 00                    A:02 X:55 Y:69 P:25 SP:FB PPU:288, 21 CYC:2490
-    CFAF  A9 FF     LDA #$FF                        A:02 X:55 Y:69 P:25 SP:FB PPU:297, 21 CYC:2493
-    CFB1  85 01     STA $01 = FF                    A:FF X:55 Y:69 P:A5 SP:FB PPU:303, 21 CYC:2495
-    CFB3  A9 00     LDA #$00                        A:FF X:55 Y:69 P:A5 SP:FB PPU:312, 21 CYC:2498
-    CFB5  85 82     STA $82 = 00                    A:00 X:55 Y:69 P:27 SP:FB PPU:318, 21 CYC:2500
-    CFB7  A9 03     LDA #$03                        A:00 X:55 Y:69 P:27 SP:FB PPU:327, 21 CYC:2503
-    CFB9  85 83     STA $83 = 00                    A:03 X:55 Y:69 P:25 SP:FB PPU:333, 21 CYC:2505
-    CFBB  85 84     STA $84 = 00                    A:03 X:55 Y:69 P:25 SP:FB PPU:  1, 22 CYC:2508
-    CFBD  A9 00     LDA #$00                        A:03 X:55 Y:69 P:25 SP:FB PPU: 10, 22 CYC:2511
-    CFBF  85 FF     STA $FF = 00                    A:00 X:55 Y:69 P:27 SP:FB PPU: 16, 22 CYC:2513
-    CFC1  A9 04     LDA #$04                        A:00 X:55 Y:69 P:27 SP:FB PPU: 25, 22 CYC:2516
-    CFC3  85 00     STA $00 = 00                    A:04 X:55 Y:69 P:25 SP:FB PPU: 31, 22 CYC:2518
-    CFC5  A9 5A     LDA #$5A                        A:04 X:55 Y:69 P:25 SP:FB PPU: 40, 22 CYC:2521
-    CFC7  8D 00 02  STA $0200 = 00                  A:5A X:55 Y:69 P:25 SP:FB PPU: 46, 22 CYC:2523
-    CFCA  A9 5B     LDA #$5B                        A:5A X:55 Y:69 P:25 SP:FB PPU: 58, 22 CYC:2527
-    CFCC  8D 00 03  STA $0300 = 00                  A:5B X:55 Y:69 P:25 SP:FB PPU: 64, 22 CYC:2529
-    CFCF  A9 5C     LDA #$5C                        A:5B X:55 Y:69 P:25 SP:FB PPU: 76, 22 CYC:2533
-    CFD1  8D 03 03  STA $0303 = 00                  A:5C X:55 Y:69 P:25 SP:FB PPU: 82, 22 CYC:2535
-    CFD4  A9 5D     LDA #$5D                        A:5C X:55 Y:69 P:25 SP:FB PPU: 94, 22 CYC:2539
-    CFD6  8D 00 04  STA $0400 = 00                  A:5D X:55 Y:69 P:25 SP:FB PPU:100, 22 CYC:2541
-    CFD9  A2 00     LDX #$00                        A:5D X:55 Y:69 P:25 SP:FB PPU:112, 22 CYC:2545
-  > CFDB  A1 80     LDA ($80,X) @ 80 = 0200 = 5A    A:5D X:00 Y:69 P:27 SP:FB PPU:118, 22 CYC:2547
-  > CFDD  C9 5A     CMP #$5A                        A:5A X:00 Y:69 P:25 SP:FB PPU:136, 22 CYC:2553    
+    /* so where 0x10 come from ?
+      http://www.zimmers.net/anonftp/pub/cbm/documents/chipdata/64doc
+      PHP always pushes the Break (B) flag as a `1' to the stack.
+      Jukka Tapanimäki claimed in C=lehti issue 3/89, on page 27 that the processor makes a logical OR between the status register's bit 4 and the bit 8 of the stack pointer register (which is always 1).
+      He did not give any reasons for this argument, and has refused to clarify it afterwards. Well, this was not the only error in his article...
     */
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC + 1];
-    addr.addrH = 0x00;
-    addr.addr = (addr.addr + cpu.X) & 0xFF;
-
-    union cpu_addr addr2;
-    addr2.addrL = mem[addr.addr];
-    addr2.addrH = mem[(addr.addr + 1) & 0xFF]; // wrap around zero page
-
-//CFF2  A1 FF     LDA ($FF,X) @ FF = 0400 = 5D    A:5C X:00 Y:69 P:27 SP:FB PPU:232, 22 CYC:2585
-//CFF4  C9 5D     CMP #$5D                        A:5D X:00 Y:69 P:25 SP:FB PPU:250, 22 CYC:2591
+    return cpu.P.P | 0x10;
+}
 
+static inline void
+cpu_PLP (uint8_t value)
+{
+    //https://wiki.nesdev.com/w/index.php/Status_flags
+    // Two instructions (PLP and RTI) pull a byte from the stack and set all the flags. They ignore bits 5 and 4.
+    // ignore bit 5 and 4
+    cpu.P.P = (value & 0xCF) | (cpu.P.P & 0x30);
+}
 
-//CFF8  A2 81     LDX #$81                        A:5D X:00 Y:69 P:27 SP:FB PPU:262, 22 CYC:2595
-//CFFA  A1 FF     LDA ($FF,X) @ 80 = 0200 = 5A    A:5D X:81 Y:69 P:A5 SP:FB PPU:268, 22 CYC:2597
-//CFFC  C9 5A     CMP #$5A                        A:5A X:81 Y:69 P:25 SP:FB PPU:286, 22 CYC:2603
+static inline uint8_t
+cpu_ROL (uint8_t value)
+{
+    uint8_t old = value;
 
-//FD: PC:CFFA Nv-bvdIzC A:5D X:81 Y:69 PS:A5 SP:FB IR:A1 (LDA,2) CYCLE:2597
+    value = value << 1;
+    value = value | cpu.P.C;
 
-    cpu.A = mem[addr2.addr];
+    cpu.P.C = NFLAG (old);
+    cpu.P.Z = ZFLAG (value);
+    cpu.P.N = NFLAG (value);
+    return value;
+}
 
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+static inline void
+cpu_ROL_A (void)
+{
+    cpu.A = cpu_ROL (cpu.A);
 }
 
-void
-cpu_LDA_IND_Y (void)
+static inline uint8_t
+cpu_ROR (uint8_t value)
 {
-    cpu.A = mem[mem[cpu.PC+1]] + cpu.Y;
+    uint8_t bit0 = value & 0b00000001;
 
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    value = value >> 1;
+    value = value | (cpu.P.C << 7);
 
-    // FIXME: compute the exact cpu cycl count (page cross)
-    cpu_FIXME ("LDA_IND_Y: add 1 to cycles if page boundery is crossed");
+    cpu.P.C = bit0;
+    cpu.P.Z = ZFLAG (value);
+    cpu.P.N = NFLAG (value);
+    return value;
 }
 
-void
-cpu_LDA_ZERO (void)
+static inline void
+cpu_ROR_A (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
-
-    cpu.A = mem[addr.addr];
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    cpu.A = cpu_ROR (cpu.A);
 }
 
-void
-cpu_LDA_ZERO_X (void)
+static inline void
+cpu_SBC (uint8_t value)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    uint16_t tot = 0xFF + cpu.A - value + cpu.P.C;
+    int lo = (cpu.A & 0x0F) - (value & 0x0F) - !cpu.P.C;
+    int hi = (cpu.A >> 4) - (value >> 4);
 
-    cpu.A = mem[addr.addr + cpu.X];
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    if ((cpu.A ^ value) & 0x80) {
+        if (tot < 0x80 || tot >= 0x180) {
+            cpu.P.V = 0;
+        } else {
+            cpu.P.V = 1;
+        }
+    } else {
+        cpu.P.V = 0;
+    }
 
-}
+    if (tot < 0x100) {
+      cpu.P.C = 0;
+    } else {
+      cpu.P.C = 1;
+    }
 
-void 
-cpu_LDX_ABS (void) 
-{
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2]; 
-    cpu.X = mem[addr.addr]; 
+    cpu.A = tot & 0xFF;
 
-    cpu.P.Z = ZFLAG (cpu.X);
-    cpu.P.N = NFLAG (cpu.X);
+    cpu.P.N = NFLAG (cpu.A);
+    cpu.P.Z = ZFLAG (cpu.A);
+
+    // decimal: the flags are the binary ones, only A is fixed up
+    if (cpu.P.D) {
+        if (lo < 0) {
+            lo -= 6;
+            hi--;
+        }
+        if (hi < 0) hi -= 6;
+        cpu.A = ((hi & 0x0F) << 4) | (lo & 0x0F);
+    }
 }
 
-void
-cpu_LDX_IMM (void)
+static inline void
+cpu_SEC (void)
 {
-	cpu.X = mem[cpu.PC+1];
-    cpu.P.Z = ZFLAG (cpu.X);
-    cpu.P.N = NFLAG (cpu.X);
+    cpu.P.C = 1;
 }
 
-void
-cpu_LDX_ZERO (void)
+static inline void
+cpu_SED (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
-
-    cpu.X = mem[addr.addr];
-    cpu.P.Z = ZFLAG (cpu.X);
-    cpu.P.N = NFLAG (cpu.X);
+    cpu.P.D = 1;
 }
 
-void
-cpu_LDY (void)
+static inline void
+cpu_SEI (void)
 {
-    cpu.Y = mem[cpu.PC+1];
-    cpu.P.Z = ZFLAG (cpu.Y);
-    cpu.P.N = NFLAG (cpu.Y);
+    cpu.P.I = 1;
 }
 
-void
-cpu_LDY_ABS (void)
+static inline uint8_t
+cpu_STA (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
-    cpu.Y = mem[addr.addr];
-
-    cpu.P.Z = ZFLAG (cpu.Y);
-    cpu.P.N = NFLAG (cpu.Y);
+    return cpu.A;
 }
 
-void
-cpu_LDY_ZERO (void)
+static inline uint8_t
+cpu_STX (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
-
-    cpu.Y = mem[addr.addr];
-    cpu.P.Z = ZFLAG (cpu.Y);
-    cpu.P.N = NFLAG (cpu.Y);
+    return cpu.X;
 }
 
-void
-cpu_LDY_ZERO_X (void)
+static inline uint8_t
+cpu_STY (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
-
-    cpu.Y = mem[addr.addr + cpu.X];
-    cpu.P.Z = ZFLAG (cpu.Y);
-    cpu.P.N = NFLAG (cpu.Y);
+    return cpu.Y;
 }
 
-void 
-cpu_LSR (void)
+static inline void
+cpu_TAX (void)
 {
-    cpu.P.C = cpu.A & 0b00000001;
-    cpu.A = cpu.A >> 1;
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = 0;
+    cpu.X = cpu.A;
+    cpu.P.Z = ZFLAG (cpu.X);
+    cpu.P.N = NFLAG (cpu.X);
 }
 
-void
-cpu_NOP (void)
+static inline void
+cpu_TAY (void)
 {
+    cpu.Y = cpu.A;
+    cpu.P.Z = ZFLAG (cpu.Y);
+    cpu.P.N = NFLAG (cpu.Y);
 }
 
-void
-cpu_ORA_ABS (void)
+static inline void
+cpu_TSX (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
+    cpu.X = cpu.SP;
+    cpu.P.Z = ZFLAG (cpu.X);
+    cpu.P.N = NFLAG (cpu.X);
 
-    cpu.A = cpu.A | mem[addr.addr];
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
 }
 
-void 
-cpu_ORA_IMM (void)
+static inline void
+cpu_TXA (void)
 {
-    cpu.A = cpu.A | mem[cpu.PC+1];
+    cpu.A = cpu.X;
     cpu.P.Z = ZFLAG (cpu.A);
     cpu.P.N = NFLAG (cpu.A);
 }
 
-
-void
-cpu_ROL (void)
+static inline void
+cpu_TXS (void)
 {
-    uint8_t OldRegA = cpu.A;
-
-    cpu.A = cpu.A << 1;
-    cpu.A = cpu.A | cpu.P.C;
-
-    cpu.P.C = NFLAG (OldRegA);
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
-
+    cpu.SP = cpu.X;
 }
 
-
-void
-cpu_ROR (void)
+static inline void
+cpu_TYA (void)
 {
-    uint8_t bit0 = cpu.A & 0b00000001;
-
-    cpu.A = cpu.A >> 1;
-    cpu.A = cpu.A | (cpu.P.C << 7);
-
-    cpu.P.C = bit0;
+    cpu.A = cpu.Y;
     cpu.P.Z = ZFLAG (cpu.A);
     cpu.P.N = NFLAG (cpu.A);
 }
 
+// istructions with cycles of their own
 
-void
-cpu_RTS (void)
+// BPL BMI BVC BVS BCC BCS BNE BEQ: IR bits 7-6 pick the flag, bit 5 is the
+// value that takes the branch
+static const uint8_t branch_flag[4] = { 0x80, 0x40, 0x01, 0x02 };   // N V C Z
+
+// taken: one cycle, one more if the target is not on the page of the next
+// istruction. a taken branch that stays on the page doesn't poll again
+static void
+cpu_BRANCH (int one)
 {
-    cpu.SP++;
-    cpu.PCL = mem[cpu.SP + STACKBASE];
-    cpu.SP++;    
-    cpu.PCH = mem[cpu.SP + STACKBASE];
+    switch (cpu.tcycle) {
+    case 1:
+        cpu_poll ();
+        if (((cpu.P.P & branch_flag[cpu.IR >> 6]) != 0) != ((cpu.IR >> 5) & 1)) {
+            DONE;
+        }
+        NEXT (2);
+    case 2:
+        cpu.ea = cpu.PC + 2 + (int8_t)cpu_arg (1);
+        if ((((uint16_t)(cpu.PC + 2)) ^ cpu.ea) <= 0xFF) {
+            cpu.PC = cpu.ea - 2;
+            DONE;
+        }
+        NEXT (3);
+    case 3:
+        cpu_poll ();
+        cpu.PC = cpu.ea - 2;
+        DONE;
+    }
 }
 
-void
-cpu_RTI (void)
+// BRK, and the interrupt sequence: an interrupt runs these cycles with the
+// opcode forced to $00, pushes PC and P without the break flag, takes the
+// vector at $FFFE and leaves the PC alone after
+static void
+cpu_BRK (int one)
 {
-    cpu.SP++;
-    uint8_t brk = cpu.P.B;
+    int irq = (cpu.intr == CPU_INTR_SEQ);
 
-    cpu.P.P = mem[cpu.SP + STACKBASE];
-    cpu.P.B = brk; // not sure about this... see http://www.oxyron.de/html/opcodes02.html
-    cpu.P.X = 1; // unused cant be restored
+    switch (cpu.tcycle) {
+    case 1:
+        if (!irq) {
+            cpu_FIXME ("BRK: softirq not implemented"); // softirq pls
+            stats_add (&stats_thread ()->irq, 1);
 
-    cpu.SP++;
-    cpu.PCL = mem[cpu.SP + STACKBASE];
-    cpu.SP++;    
-    cpu.PCH = mem[cpu.SP + STACKBASE];
+            cpu.P.I = 1;
+            cpu.P.B = 1;
 
+            // FIXME: raise softirq here
+        }
+        NEXT (2);
+    case 2:
+        if (irq) cpu_push (cpu.PCH);
+        NEXT (3);
+    case 3:
+        if (irq) cpu_push (cpu.PCL);
+        NEXT (4);
+    case 4:
+        if (irq) cpu_push ((cpu.P.P & 0xEF) | 0x20);
+        NEXT (5);
+    case 5:
+        if (irq) {
+            cpu.P.I = 1;
+            cpu.ea  = cpu_read (0xFFFE);
+        }
+        NEXT (6);
+    case 6:
+        if (irq) cpu.PC = cpu.ea | (cpu_read (0xFFFF) << 8);
+        DONE;
+    }
 }
 
-void
-cpu_SBC_IMM (void)
+static void
+cpu_JMP_ABS (int one)
 {
-    uint16_t tot = 0xFF + cpu.A - mem[cpu.PC+1] + cpu.P.C;
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu_poll ();
+        cpu.PC = cpu.ea | (cpu_arg (2) << 8);
+        DONE;
+    }
+}
 
-    if ((cpu.A ^ mem[cpu.PC+1]) & 0x80) {
-        if (tot < 0x80 || tot >= 0x180) {
-            cpu.P.V = 0;
-        } else {
-            cpu.P.V = 1;
-        }
-    } else {
-        cpu.P.V = 0;
+// JMP ($xxFF) takes the high byte from $xx00, the pointer doesn't carry
+static void
+cpu_JMP_IND (int one)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        cpu.ea |= cpu_arg (2) << 8;
+        NEXT (3);
+    case 3:
+        cpu.data = cpu_read (cpu.ea);
+        NEXT (4);
+    case 4:
+        cpu_poll ();
+        cpu.PC = cpu.data | (cpu_read ((cpu.ea & 0xFF00) | ((cpu.ea + 1) & 0x00FF)) << 8);
+        DONE;
     }
+}
 
-    if (tot < 0x100) {
-      cpu.P.C = 0;
-    } else {
-      cpu.P.C = 1;
+// the last byte of the JSR goes on the stack, RTS adds one
+static void
+cpu_JSR (int one)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        cpu.ea = cpu_arg (1);
+        NEXT (2);
+    case 2:
+        NEXT (3);
+    case 3:
+        cpu_push ((uint16_t)(cpu.PC + 2) >> 8);
+        NEXT (4);
+    case 4:
+        cpu_push ((cpu.PC + 2) & 0xFF);
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu.PC = cpu.ea | (cpu_arg (2) << 8);
+        DONE;
     }
+}
 
-    cpu.A = tot & 0xFF;
+// B is kept (not sure about this... see http://www.oxyron.de/html/opcodes02.html),
+// the unused bit can't be restored
+static void
+cpu_RTI (int one)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        NEXT (2);
+    case 2:
+        NEXT (3);
+    case 3:
+        cpu.P.P = (cpu_pull () & 0xCF) | (cpu.P.P & 0x10) | 0x20;
+        NEXT (4);
+    case 4:
+        cpu.ea = cpu_pull ();
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu.PC = cpu.ea | (cpu_pull () << 8);
+        DONE;
+    }
+}
 
-    cpu.P.N = NFLAG (cpu.A);
-    cpu.P.Z = ZFLAG (cpu.A);
+static void
+cpu_RTS (int one)
+{
+    switch (cpu.tcycle) {
+    case 1:
+        NEXT (2);
+    case 2:
+        NEXT (3);
+    case 3:
+        cpu.ea = cpu_pull ();
+        NEXT (4);
+    case 4:
+        cpu.ea |= cpu_pull () << 8;
+        NEXT (5);
+    case 5:
+        cpu_poll ();
+        cpu.PC = cpu.ea;
+        DONE;
+    }
 }
 
+static void
+cpu_NOTIMPL (int one)
+{
+    (void)one;
+
+    cpu_poll ();
+    cpu_FIXME (NULL);
+    DONE;
+}
+
+// opcode bits aaabbbcc: the addressing mode of every opcode, official or not
+// http://www.llx.com/Neil/a2/opcodes.html
+#define OP_A(op) (((op) >> 5) & 7)
+#define OP_B(op) (((op) >> 2) & 7)
+#define OP_C(op) ((op) & 3)
+
+// LDX STX SAX LAX index with Y
+#define OP_Y(op) (OP_C (op) >= 2 && (OP_A (op) == 4 || OP_A (op) == 5))
+
+#define OP_MODE(op) (                                                                               \
+    OP_B (op) == 0 ? (OP_C (op) & 1 ? CPU_AM_INDX : OP_A (op) >= 4 ? CPU_AM_IMM :                   \
+                      (op) == 0x20 ? CPU_AM_ABS : CPU_AM_IMP) :                                     \
+    OP_B (op) == 1 ? CPU_AM_ZP :                                                                    \
+    OP_B (op) == 2 ? (OP_C (op) & 1 ? CPU_AM_IMM : OP_C (op) == 2 && OP_A (op) < 4 ? CPU_AM_ACC :   \
+                      CPU_AM_IMP) :                                                                 \
+    OP_B (op) == 3 ? ((op) == 0x6C ? CPU_AM_IND : CPU_AM_ABS) :                                     \
+    OP_B (op) == 4 ? (OP_C (op) & 1 ? CPU_AM_INDY : OP_C (op) == 0 ? CPU_AM_REL : CPU_AM_IMP) :     \
+    OP_B (op) == 5 ? (OP_Y (op) ? CPU_AM_ZPY : CPU_AM_ZPX) :                                        \
+    OP_B (op) == 6 ? (OP_C (op) & 1 ? CPU_AM_ABSY : CPU_AM_IMP) :                                   \
+                     (OP_Y (op) ? CPU_AM_ABSY : CPU_AM_ABSX))
+
+// the cycles each kind of handler takes for a mode (page cross and branch
+// cycles not counted), the spec has to agree. OWN handlers count their own
+#define CLOCK_RD(m, c)  ((m) == CPU_AM_IMM ? 2 : (m) == CPU_AM_ZP ? 3 : (m) == CPU_AM_INDX ? 6 :   \
+                         (m) == CPU_AM_INDY ? 5 : 4)
+#define CLOCK_WR(m, c)  ((m) == CPU_AM_ZP ? 3 : (m) == CPU_AM_INDX || (m) == CPU_AM_INDY ? 6 :     \
+                         (m) == CPU_AM_ABSX || (m) == CPU_AM_ABSY ? 5 : 4)
+#define CLOCK_RMW(m, c) ((m) == CPU_AM_ZP ? 5 : (m) == CPU_AM_ABSX ? 7 : 6)
+#define CLOCK_REG(m, c) 2
+#define CLOCK_PSH(m, c) 3
+#define CLOCK_PUL(m, c) 4
+#define CLOCK_OWN(m, c) (c)
+
+// the spec is checked at compile time
+#define ISA_OP(op, name, mode, clock, step, kind, f)                                                \
+    _Static_assert (sizeof (name) == 4, "opcode " #op ": the name is 3 letters");                  \
+    _Static_assert (CPU_AM_##mode == OP_MODE (op), "opcode " #op ": mode doesn't match the opcode"); \
+    _Static_assert ((step) == 0 || (step) == CPU_AM_LEN (CPU_AM_##mode) || (op) == 0x00,           \
+                    "opcode " #op ": step is neither 0 nor the length");                            \
+    _Static_assert ((clock) >= 2 && (clock) <= 7, "opcode " #op ": clock out of range");           \
+    _Static_assert ((clock) == CLOCK_##kind (CPU_AM_##mode, clock),                                 \
+                    "opcode " #op ": clock doesn't match the cycles of the kind");
+#include "isa.h"
+#undef ISA_OP
+
+// an opcode listed twice is a redeclared enumerator
+enum {
+#define ISA_OP(op, name, mode, clock, step, kind, f) ISA_SEEN_##op,
+#include "isa.h"
+#undef ISA_OP
+};
+
+// the handlers: the cycles of the kind for the mode, with the operation of the
+// opcode. a kind without the mode doesn't compile
+#define KIND_RD(mode, f)  cpu_rd##mode (one, f)
+#define KIND_WR(mode, f)  cpu_wr##mode (one, f)
+#define KIND_RMW(mode, f) cpu_rmw##mode (one, f)
+#define KIND_REG(mode, f) cpu_reg (one, f)
+#define KIND_PSH(mode, f) cpu_psh (one, f)
+#define KIND_PUL(mode, f) cpu_pul (one, f)
+#define KIND_OWN(mode, f) f (one)
+
+#define ISA_OP(op, name, mode, clock, step, kind, f) \
+    static void cpu_op##op (int one) { KIND_##kind (mode, f); }
+#include "isa.h"
+#undef ISA_OP
+
+_Static_assert (sizeof (struct isa_t) == 8, "8 opcodes per cache line");
+
+// not implemented: the mode from the opcode bits, so the disassembler and the
+// core agree on the length (the core steps over it when debug_fixmeCheck is on)
+#define ISA_NONE(op)    [op] = { "---", CPU_AM_LEN (OP_MODE (op)), OP_MODE (op) }
+#define TIMING_NONE(op) [op] = { 2, CPU_AM_LEN (OP_MODE (op)) }
+#define ISA_ALL16(h, none)                                                                          \
+    none (h + 0x0), none (h + 0x1), none (h + 0x2), none (h + 0x3),                                 \
+    none (h + 0x4), none (h + 0x5), none (h + 0x6), none (h + 0x7),                                 \
+    none (h + 0x8), none (h + 0x9), none (h + 0xA), none (h + 0xB),                                 \
+    none (h + 0xC), none (h + 0xD), none (h + 0xE), none (h + 0xF)
+#define ISA_ALL(none)                                                                               \
+    ISA_ALL16 (0x00, none), ISA_ALL16 (0x10, none), ISA_ALL16 (0x20, none), ISA_ALL16 (0x30, none), \
+    ISA_ALL16 (0x40, none), ISA_ALL16 (0x50, none), ISA_ALL16 (0x60, none), ISA_ALL16 (0x70, none), \
+    ISA_ALL16 (0x80, none), ISA_ALL16 (0x90, none), ISA_ALL16 (0xA0, none), ISA_ALL16 (0xB0, none), \
+    ISA_ALL16 (0xC0, none), ISA_ALL16 (0xD0, none), ISA_ALL16 (0xE0, none), ISA_ALL16 (0xF0, none)
+
+// the spec overrides the defaults
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+
+const struct isa_t ISA[256] __attribute__ ((aligned (64))) = {
+    ISA_ALL (ISA_NONE),
+#define ISA_OP(op, name, mode, clock, step, kind, f) \
+    [op] = { name, CPU_AM_LEN (CPU_AM_##mode), CPU_AM_##mode },
+#include "isa.h"
+#undef ISA_OP
+};
+
+const cpu_op_f cpu_op[256] __attribute__ ((aligned (64))) = {
+    [0x00 ... 0xFF] = cpu_NOTIMPL,
+#define ISA_OP(op, name, mode, clock, step, kind, f) [op] = cpu_op##op,
+#include "isa.h"
+#undef ISA_OP
+};
+
+const struct cpu_timing cpu_opTiming[256] __attribute__ ((aligned (64))) = {
+    ISA_ALL (TIMING_NONE),
+#define ISA_OP(op, name, mode, clock, step, kind, f) [op] = { clock, step },
+#include "isa.h"
+#undef ISA_OP
+};
+
+#pragma GCC diagnostic pop
 
 void
-cpu_SEC (void)
+cpu_init  (double freq)
 {
-    cpu.P.C = 1;
+    cpu_freq  = (freq ? freq : CPU_PAL_HZ);
+    cpu_frame = (cpu_freq > (CPU_PAL_HZ + CPU_NTSC_HZ) / 2 ? CPU_NTSC_FRAME : CPU_PAL_FRAME);
 }
 
 void
-cpu_SED (void)
+cpu_free (void)
 {
-    cpu.P.D = 1;
+    cpu_unmapRoms ();
 }
 
 void
-cpu_SEI (void)
+cpu_FIXME (const char *message)
 {
-    cpu.P.I = 1;
+    stats_add (&stats_thread ()->fixme, 1);
+
+    if (debug_fixmeOn) {
+        debug_fixme ();
+        return;
+    }
+
+    printf ("<FIX THE OPCODE>\n");
+    cpu_dump (message);
+    printf ("</FIX THE OPCODE>\n"); 
+
+    if (!message) exit (EXIT_FAILURE);
 }
 
-void 
-cpu_STA_ABS (void)
+// FNV-1a 64, start with hash = 0 
+uint64_t
+cpu_hash (const uint8_t *data, uint32_t len, uint64_t hash)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
+    if (!hash) hash = 0xCBF29CE484222325ULL;
 
-    mem[addr.addr] = cpu.A;
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
 }
 
-void
-cpu_STA_ABS_X (void)
+// remember what has been loaded where, snapshots carry the hash and not the bytes
+static void
+cpu_trackRom (uint16_t address, uint32_t len, uint64_t hash)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
+    int i;
+
+    for (i = 0; i < cpu_nroms; i++) {
+        if (cpu_roms[i].address == address) break;
+    }
 
-    mem[addr.addr + cpu.X] = cpu.A;   
+    if (i == cpu_nroms) {
+        if (cpu_nroms == CPU_MAXROM) return;
+        cpu_nroms++;
+    }
 
+    cpu_roms[i].address = address;
+    cpu_roms[i].len     = len;
+    cpu_roms[i].hash    = (hash ? hash : cpu_hash (&mem[address], len, 0));
 }
 
-void
-cpu_STA_ABS_Y (void)
+const char *
+cpu_strerror (int err)
+{
+    switch (err) {
+    case CPU_OK:      return "ok";
+    case CPU_ENOENT:  return "file not found";
+    case CPU_EIO:     return "read error";
+    case CPU_ESIZE:   return "image does not fit";
+    case CPU_EFORMAT: return "bad image header";
+    case CPU_EROM:    return "target is shared read only rom";
+    case CPU_EFULL:   return "table full";
+    case CPU_ESTATE:  return "machine not ready";
+    case CPU_ENOMEM:  return "out of memory";
+    }
+    return "unknown error";
+}
+
+static enum cpu_imgfmt
+cpu_imageFormat (const char *file)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
+    const char *ext = strrchr (file, '.');
 
-    mem[addr.addr + cpu.Y] = cpu.A;   
+    if (ext && !strcasecmp (ext, ".prg")) return CPU_IMG_PRG;
+    if (ext && !strcasecmp (ext, ".nes")) return CPU_IMG_NES;
+    return CPU_IMG_RAW;
 }
 
-void
-cpu_STA_IND_X (void)
+// load a whole image with a single read straight into mem
+// RAW  'offset' bytes are skipped, data goes at 'address'
+// PRG  data goes at the 2 byte load address in front of it, or at 'address' if not 0
+// NES  PRG ROM banks go at 'address' ($C000 for one bank, $8000 for two if 0)
+// on success *start/*len (if not NULL) tell where it landed
+int
+cpu_loadImage (const char *file, enum cpu_imgfmt fmt, int address, uint32_t offset, uint16_t *start, uint32_t *len)
 {
-    //2612
+    uint8_t hdr[16];
+    uint32_t size;
+    long fsize = -1;
 
-    union cpu_addr addr1;
-    addr1.addr = mem[cpu.PC+1] + cpu.X;
+    FILE *f = fopen (file, "rb");
+    if (!f) return CPU_ENOENT;
+
+    if (fseek (f, 0, SEEK_END) || (fsize = ftell (f)) < 0 || fsize > CPU_MEMSIZE + 0x10000) {
+        fclose (f);
+        return (fsize < 0 ? CPU_EIO:CPU_ESIZE);
+    }
+    size = fsize;
+
+    if (fmt == CPU_IMG_AUTO) fmt = cpu_imageFormat (file);
+
+    switch (fmt) {
+    case CPU_IMG_PRG:
+        if (size < 2 || fseek (f, 0, SEEK_SET) || fread (hdr, 2, 1, f) != 1) goto format;
+        if (address == CPU_IMG_HEADER) address = hdr[0] | (hdr[1] << 8);
+        offset = 2;
+        break;
+
+    case CPU_IMG_NES:
+        if (size < 16 || fseek (f, 0, SEEK_SET) || fread (hdr, 16, 1, f) != 1) goto format;
+        if (memcmp (hdr, "NES\x1A", 4) || hdr[4] == 0 || hdr[4] > 2) goto format;
+
+        offset = 16 + ((hdr[6] & 0x04) ? 512:0);  // trainer
+        if (size < offset + hdr[4] * 0x4000) goto format;
+        size = offset + hdr[4] * 0x4000;           // CHR ROM is not cpu memory
+        if (address == CPU_IMG_HEADER) address = (hdr[4] == 1 ? 0xC000:0x8000);
+        break;
+
+    default:
+        if (address == CPU_IMG_HEADER) goto format;
+        break;
+    }
 
-    union cpu_addr addr2;
-    addr2.addrL = mem[addr1.addr];
-    addr2.addrH = mem[addr1.addr+1];
+    if (address < 0 || size <= offset || address + (size - offset) > CPU_MEMSIZE) {
+        fclose (f);
+        return CPU_ESIZE;
+    }
+    size -= offset;
 
+    for (uint32_t p = address >> 8; p <= (address + size - 1) >> 8; p++) {
+        if (mem_rom[p]) {
+            fclose (f);
+            return CPU_EROM;
+        }
+    }
 
-//printf("add1 %0x %0x %0x\n", addr1.addr, addr2.addr, mem[addr2.addr]);
-    mem[addr2.addr] = cpu.A;
-//printf("DUmP  %0x\n", mem[addr2.addr]);
+    if (fseek (f, offset, SEEK_SET) || fread (&mem[address], size, 1, f) != 1) {
+        fclose (f);
+        return CPU_EIO;
+    }
+    fclose (f);
 
+    // written behind cpu_write's back
+    for (uint32_t p = address >> 8; p <= (address + size - 1) >> 8; p++) {
+        mem_dirty[p] = 1;
+    }
 
-//2674
-//FIXME D031  AD 00 04  LDA $0400 = AD                  A:AC X:00 Y:69 P:27 SP:FB PPU:158, 23 CYC:2674    
+    if (start) *start = address;
+    if (len)   *len   = size;
+    return CPU_OK;
 
+format:
+    fclose (f);
+    return CPU_EFORMAT;
 }
 
-void
-cpu_STA_IND_Y (void)
+// raw rom image, tracked by hash for snapshots
+int
+cpu_addRom (uint16_t address, const char *romfile, uint16_t offset)
 {
-    //printf("FIXME PLZ  \n"); // come sopra
-    union cpu_addr addr1;
-    addr1.addr = mem[cpu.PC+1] + cpu.Y;
+    uint32_t len;
 
-    union cpu_addr addr2;
-    addr2.addrL = mem[addr1.addr];
-    addr2.addrH = mem[addr1.addr+1];
+    int err = cpu_loadImage (romfile, CPU_IMG_RAW, address, offset, NULL, &len);
+    if (err == CPU_OK) {
+        cpu_trackRom (address, len, 0);
+    }
+    return err;
+}
 
-    mem[addr2.addr] = cpu.A;
+// shared rom cache
+// an image is hashed each time it is mapped, one open fd per content, mapped
+// read only on top of mem. every machine forked from here, and every process mapping the same
+// file, reads the very same page cache pages: no private copy, no way to write it
 
-}
+#define ROMCACHE 8
 
-void 
-cpu_STA_ZERO (void) 
-{
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+struct rom_cache {
+    off_t    size;
+    uint64_t hash;
+    int      fd;
+};
 
-    mem[addr.addr] = cpu.A;
-}
+static struct rom_cache romcache[ROMCACHE];
+static int nromcache;
 
-void
-cpu_STX_ABS (void)
+// keyed on size and content hash, what the file holds now: a file rewritten
+// in place (same inode, mtime in the same second) is a new entry. a hit takes
+// the fd just hashed, the one it had may no longer hold those bytes
+static struct rom_cache *
+cpu_romCache (const char *romfile)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
+    struct stat st;
 
-    mem[addr.addr] = cpu.X;
-}
+    int fd = open (romfile, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
 
-void
-cpu_STX_ZERO (void)
-{
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    if (fstat (fd, &st) != 0 || st.st_size == 0) {
+        close (fd);
+        return NULL;
+    }
 
-    mem[addr.addr] = cpu.X;
-}
+    void *p = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close (fd);
+        return NULL;
+    }
+    uint64_t hash = cpu_hash (p, st.st_size, 0);
+    munmap (p, st.st_size);
 
-void
-cpu_STY_ABS (void)
-{
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = mem[cpu.PC+2];
+    struct rom_cache *c = NULL;
+    for (int i = 0; i < nromcache; i++) {
+        if (romcache[i].size == st.st_size && romcache[i].hash == hash) c = &romcache[i];
+    }
+    if (c) {
+        close (c->fd);
+    } else {
+        if (nromcache == ROMCACHE) {
+            close (fd);
+            return NULL;
+        }
+        c = &romcache[nromcache++];
+    }
 
-    mem[addr.addr] = cpu.Y;
+    c->size = st.st_size;
+    c->hash = hash;
+    c->fd   = fd;
+    return c;
 }
 
-void
-cpu_STA_ZERO_X (void)
+// like cpu_addRom, but the image is shared and read only: cpu writes to it are
+// lost (as they would land in the ram below the rom on the real thing).
+// address and size must be host page aligned, else this falls back to a copy.
+// don't use it where i/o overlays the rom ($D000 character rom)
+int
+cpu_mapRom (uint16_t address, const char *romfile)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    long page = sysconf (_SC_PAGESIZE);
+    struct rom_cache *c = cpu_romCache (romfile);
 
-    mem[addr.addr + cpu.X] = cpu.A;
-}
+    if (!c) return cpu_addRom (address, romfile, 0);
+    if (c->size == 0 || address + c->size > CPU_MEMSIZE) return CPU_ESIZE;
+    if ((address % page) || (c->size % page)) return cpu_addRom (address, romfile, 0);
 
-void
-cpu_STY_ZERO (void)
-{
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    if (mmap (&mem[address], c->size, PROT_READ, MAP_SHARED | MAP_FIXED, c->fd, 0) == MAP_FAILED) {
+        return CPU_EIO;
+    }
+
+    memset (&mem_rom[address >> 8], 1, c->size >> 8);
+    cpu_trackRom (address, c->size, c->hash);
 
-    mem[addr.addr] = cpu.Y;
+    return CPU_OK;
 }
 
+// give every shared rom page back to private, writable, zeroed memory
 void
-cpu_STY_ZERO_X (void)
+cpu_unmapRoms (void)
 {
-    union cpu_addr addr;
-    addr.addrL = mem[cpu.PC+1];
-    addr.addrH = 0x00;
+    for (int p = 0; p < (CPU_MEMSIZE >> 8); p++) {
+        if (!mem_rom[p]) continue;
 
-    mem[addr.addr + cpu.X] = cpu.Y;
+        int n = 0;
+        while (p + n < (CPU_MEMSIZE >> 8) && mem_rom[p + n]) {
+            mem_rom[p + n++] = 0;
+        }
+        mmap (&mem[p << 8], n << 8, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        p += n;
+    }
 
+    for (int i = 0; i < nromcache; i++) {
+        close (romcache[i].fd);
+    }
+    nromcache = 0;
 }
 
+// copy a whole memory image in, shared rom pages are left as they are
 void
-cpu_TAX (void)
+cpu_memLoad (const uint8_t *image)
 {
-    cpu.X = cpu.A;
-    cpu.P.Z = ZFLAG (cpu.X);
-    cpu.P.N = NFLAG (cpu.X);
+    for (int p = 0; p < (CPU_MEMSIZE >> 8); p++) {
+        if (!mem_rom[p]) {
+            memcpy (&mem[p << 8], &image[p << 8], 256);
+        }
+    }
 }
 
-void 
-cpu_TAY (void)
-{
-    cpu.Y = cpu.A;
-    cpu.P.Z = ZFLAG (cpu.Y);
-    cpu.P.N = NFLAG (cpu.Y);
-}
+// pc traps, one flag per page keeps the check out of the way
+uint8_t cpu_trapPage[CPU_MEMSIZE >> 8];
 
-void
-cpu_TXA (void)
-{
-    cpu.A = cpu.X;
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
-}
+static struct {
+    uint16_t   pc;
+    cpu_trap_f f;
+} traps[CPU_MAXTRAP];
+static int ntraps;
 
-void
-cpu_TSX (void)
+// f NULL removes the trap at pc
+int
+cpu_setTrap (uint16_t pc, cpu_trap_f f)
 {
-    cpu.X = cpu.SP;
-    cpu.P.Z = ZFLAG (cpu.X);
-    cpu.P.N = NFLAG (cpu.X);
+    int i;
+
+    for (i = 0; i < ntraps; i++) {
+        if (traps[i].pc == pc) break;
+    }
+
+    if (!f) {
+        if (i == ntraps) return CPU_OK;
+        traps[i] = traps[--ntraps];
+
+        cpu_trapPage[pc >> 8] = 0;
+        for (i = 0; i < ntraps; i++) {
+            if ((traps[i].pc >> 8) == (pc >> 8)) cpu_trapPage[pc >> 8] = 1;
+        }
+        return CPU_OK;
+    }
+
+    if (i == ntraps) {
+        if (ntraps == CPU_MAXTRAP) return CPU_EFULL;
+        ntraps++;
+    }
+    traps[i].pc = pc;
+    traps[i].f  = f;
+    cpu_trapPage[pc >> 8] = 1;
 
+    return CPU_OK;
 }
 
-void
-cpu_TXS (void)
+int
+cpu_trap (void)
 {
-    cpu.SP = cpu.X;
+    for (int i = 0; i < ntraps; i++) {
+        if (traps[i].pc == cpu.PC) return traps[i].f ();
+    }
+    return 0;
 }
 
+static enum cpu_core core = CPU_CORE_DEFAULT;
 
 void
-cpu_PHA (void)
+cpu_setCore (enum cpu_core c)
 {
-    mem[STACKBASE + cpu.SP] = cpu.A;
-    cpu.SP--;
+    core = c;
+
+    // never switch in the middle of an istruction
+    cpu.tcycle = 0;
 }
 
 void
-cpu_PHP (void)
+cpu_irq (int level)
 {
-    /* so where 0x10 come from ?
-      http://www.zimmers.net/anonftp/pub/cbm/documents/chipdata/64doc
-      PHP always pushes the Break (B) flag as a `1' to the stack.
-      Jukka Tapanimäki claimed in C=lehti issue 3/89, on page 27 that the processor makes a logical OR between the status register's bit 4 and the bit 8 of the stack pointer register (which is always 1).
-      He did not give any reasons for this argument, and has refused to clarify it afterwards. Well, this was not the only error in his article...    
-    */
-    mem[STACKBASE + cpu.SP] = cpu.P.P | 0x10;
-    cpu.SP--;
+    cpu.irq = (level != 0);
 }
 
-void
-cpu_PLA (void)
+// T0 of the interrupt sequence: the opcode fetch is thrown away and BRK runs
+// in its place (see cpu_BRK), the handler takes it from T1
+static void
+cpu_interrupt (void)
 {
-    cpu.SP++;
-    cpu.A = mem[STACKBASE + cpu.SP];
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    stats_add (&stats_thread ()->irq, 1);
+
+    cpu.intr   = CPU_INTR_SEQ;
+    cpu.IR     = 0x00;
+    cpu.cycle++;
+    cpu.tcycle = 1;
 }
 
-void
-cpu_PLP (void)
+// fast core: one whole istruction, every bus cycle of it in one call
+int
+cpu_step (void)
 {
-    //https://wiki.nesdev.com/w/index.php/Status_flags
-    // Two instructions (PLP and RTI) pull a byte from the stack and set all the flags. They ignore bits 5 and 4. 
-    // ignore bit 5 and 4
-    cpu.SP++;
-    gboolean oldB = cpu.P.B;
-    gboolean oldX = cpu.P.X;
-    cpu.P.P = mem[STACKBASE + cpu.SP];
-    cpu.P.B = oldB;
-    cpu.P.X = oldX;
+    if (cpu.cycle >= input_next) input_poll ();
+    if (cpu.intr) {
+        cpu_interrupt ();
+        cpu_op[0x00] (0);
+        cpu.intr = 0;
+        return 0;
+    }
+    if (cpu_trapPage[cpu.PCH] && cpu_trap ()) return 0;
+#ifndef CPU_NODEBUG
+    if ((debug_page[cpu.PCH] & DEBUG_EXEC) && debug_exec ()) return 0;
+#endif
+
+    uint16_t pc    = cpu.PC;
+    uint64_t cycle = cpu.cycle;
+
+    cpu.IR = mem[cpu.PC];
+    cpu.cycle++;
+    cpu.tcycle = 1;
+
+    cpu_op[cpu.IR] (0);
+    cpu.PC += cpu_opTiming[cpu.IR].step;
+
+    if (profile_on) profile_istr (pc, cpu.IR, cpu.cycle - cycle);
+    return 1;
 }
 
-void
-cpu_TYA (void)
+// cycle core: one bus cycle. T0 fetches the opcode, every call after runs the
+// handler's step for cpu.tcycle until it is back to 0
+static uint16_t istr_pc;
+static uint64_t istr_cycle;
+
+int
+cpu_tick (void)
 {
-    cpu.A = cpu.Y;
-    cpu.P.Z = ZFLAG (cpu.A);
-    cpu.P.N = NFLAG (cpu.A);
+    if (cpu.tcycle == 0) {
+        if (cpu.cycle >= input_next) input_poll ();
+        if (cpu.intr) {
+            cpu_interrupt ();
+            return 0;
+        }
+        if (cpu_trapPage[cpu.PCH] && cpu_trap ()) return 0;
+#ifndef CPU_NODEBUG
+        if ((debug_page[cpu.PCH] & DEBUG_EXEC) && debug_exec ()) return 0;
+#endif
+        istr_pc    = cpu.PC;
+        istr_cycle = cpu.cycle;
+
+        cpu.IR = mem[cpu.PC];
+        cpu.cycle++;
+        cpu.tcycle = 1;
+        return 0;
+    }
+
+    cpu_op[cpu.IR] (1);
+    if (cpu.tcycle) return 0;
+
+    if (cpu.intr == CPU_INTR_SEQ) {
+        cpu.intr = 0;
+        return 0;
+    }
+
+    cpu.PC += cpu_opTiming[cpu.IR].step;
+
+    if (profile_on) profile_istr (istr_pc, cpu.IR, cpu.cycle - istr_cycle);
+    return 1;
 }
 
-struct isa_t ISA[] = {
-    // +OPCODE
-    // |     +IST.LEN
-    // |     |  +PC STP   
-    // |     |  |
-    // |     |  |  +CPU CYCLE
-    // |     |  |  | 
-	{ "BRK", 1, 2, 7, cpu_BRK  },           // 0x00 BREAKPOINT FIXME:fire an irq. WTF?!? why brk do a PC+2?
-	{ "---", 2, 2, 6, cpu_FIXME},           // 0x01
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x02
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x03
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x04
-	{ "---", 2, 2, 3, cpu_FIXME},           // 0x05
-	{ "---", 2, 2, 5, cpu_FIXME},           // 0x06	
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x07
-	{ "PHP", 1, 1, 3, cpu_PHP  },           // 0x08 PHP  Push Processor Status on Stack
-	{ "ORA", 2, 2, 2, cpu_ORA_IMM},         // 0x09 ORA  OR Memory with Accumulator
-	{ "ASL", 1, 1, 2, cpu_ASL  },           // 0x0A ASL  Shift Left One Bit Accumulator
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x0B
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x0C
-	{ "ORA", 3, 3, 4, cpu_ORA_ABS},         // 0x0D ORA  OR Memory with Accumulator
-	{ "---", 3, 3, 6, cpu_FIXME},           // 0x0E
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x0F
-
-    { "BPL", 2, 2, 2, cpu_BPL  },           // 0x10 BPL  Branch on Result Plus
-    { "---", 2, 2, 5, cpu_FIXME},           // 0x11
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x12
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x13
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x14
-    { "---", 2, 2, 4, cpu_FIXME},           // 0x15
-	{ "---", 2, 2, 6, cpu_FIXME},           // 0x16
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x17
-    { "CLC", 1, 1, 2, cpu_CLC  },           // 0x18 CLC  Clear Carry Flag
-    { "---", 3, 3, 4, cpu_FIXME},           // 0x19
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x1A
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x1B
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x1C
-    { "---", 3, 3, 4, cpu_FIXME},           // 0x1D
-    { "---", 3, 3, 6, cpu_FIXME},           // 0x1E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x1F
-
-    { "JSR", 3, 0, 6, cpu_JSR  },           // 0x20 JSR  Jump to New Location Saving Return Address
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x21
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x22
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x23
-    { "BIT", 2, 2, 3, cpu_BIT_ZERO},        // 0x24 BIT  Test Bits in Memory with Accumulator
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x25
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x26
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x27
-    { "PLP", 1, 1, 4, cpu_PLP  },           // 0x28 PLP  Pull Processor Status from Stack
-    { "AND", 2, 2, 2, cpu_AND_IMM},         // 0x29 AND  AND Memory with Accumulator
-    { "ROL", 1, 1, 2, cpu_ROL  },           // 0x2A ROL  Rotate One Bit Left (Memory or Accumulator)
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x2B
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x2C
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x2D
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x2E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x2F
-
-    { "BMI", 2, 2, 2, cpu_BMI  },           // 0x30 BMI  Branch on Result Minus
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x31
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x32
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x33
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x34
-    { "AND", 2, 2, 4, cpu_AND_ZEROX},       // 0x35 AND  AND Memory with Accumulator
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x36
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x37
-    { "SEC", 1, 1, 2, cpu_SEC  },           // 0x38 SEC  Set Carry Flag
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x39
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x3A
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x3B
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x3C
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x3D
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x3E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x3F
-
-    { "RTI", 1, 0, 6, cpu_RTI  },           // 0x40 RTI  Return from Interrupt
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x41
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x42
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x43
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x44
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x45
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x46
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x47
-    { "PHA", 1, 1, 3, cpu_PHA  },           // 0x48 PHA  Push Accumulator on Stack
-    { "EOR", 2, 2, 2, cpu_EOR_IMM},         // 0x49 EOR  Exclusive-OR Memory with Accumulator
-    { "LSR", 1, 1, 2, cpu_LSR  },           // 0x4A LSR  Shift One Bit Right Accumulator
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x4B
-    { "JMP", 3, 0, 3, cpu_JMP_ABS},         // 0x4C JMP  Jump to New Location
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x4D
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x4E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x4F
-
-    { "BVC", 2, 2, 2, cpu_BVC  },           // 0x50 BVC  Branch on Overflow Clear
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x51
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x52
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x53
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x54
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x55
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x56
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x57
-    { "CLI", 1, 1, 2, cpu_CLI  },           // 0x58 CLI
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x59
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x5A
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x5B
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x5C
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x5D
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x5E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x5F
-
-    { "RTS", 1, 1, 6, cpu_RTS  },           // 0x60 RTS  Return from Subroutine
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x61
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x62
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x63
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x64
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x65
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x66
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x67
-    { "PLA", 1, 1, 4, cpu_PLA  },           // 0x68 PLA  Pull Accumulator from Stack
-    { "ADC", 2, 2, 2, cpu_ADC_IMM},         // 0x69 ADC  Add Memory to Accumulator with Carry
-    { "ROR", 1, 1, 2, cpu_ROR  },           // 0x6A ROR  Rotate One Bit Right Accumulator
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x6B
-    { "JMP", 3, 3, 5, cpu_JMP_IND},         // 0x6C JMP Jump indirect
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x6D
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x6E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x6F
-
-    { "BVS", 2, 2, 2, cpu_BVS  },           // 0x70 BVS  Branch on Overflow Set
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x71
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x72
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x73
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x74
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x75
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x76
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x77
-    { "SEI", 1, 1, 2, cpu_SEI  },           // 0x78 SEI  Set Interrupt Disable Status
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x79
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x7A
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x7B
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x7C
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x7D
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x7E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x7F
-
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x80
-    { "STA", 2, 2, 6, cpu_STA_IND_X},       // 0x81 STA  Store Accumulator in Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x82
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x83
-    { "STY", 2, 2, 3, cpu_STY_ZERO},        // 0x84 STY  Store Index Y in Memory
-    { "STA", 2, 2, 3, cpu_STA_ZERO},        // 0x85 STA  Store Accumulator in Memory
-	{ "STX", 2, 2, 3, cpu_STX_ZERO},        // 0x86 STX  Store Index X in Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x87
-    { "DEY", 1, 1, 2, cpu_DEY  },           // 0x88 DEY  Decrement Index Y 
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x89
-    { "TXA", 1, 1, 2, cpu_TXA  },           // 0x8A TXA  Transfer Index X to Accumulator
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x8B
-    { "STY", 3, 3, 4, cpu_STY_ABS},         // 0x8C STY  Sore Index Y in Memory
-    { "STA", 3, 3, 4, cpu_STA_ABS},         // 0x8D STA  Store Accumulator in Memory
-    { "STX", 3, 3, 4, cpu_STX_ABS},         // 0x8E STX  Store Index X in Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x8F
-
-    { "BCC", 2, 2, 2, cpu_BCC  },           // 0x90 BCC  Branch on Carry Clear
-    { "STA", 2, 2, 6, cpu_STA_IND_Y},       // 0x91 STA  Store Accumulator in Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x92
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x93
-    { "STY", 2, 2, 4, cpu_STY_ZERO_X},      // 0x94 STY  Sore Index Y in Memory
-    { "STA", 2, 2, 4, cpu_STA_ZERO_X},      // 0x95 STA  Store Accumulator in Memory
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0x96
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x97
-    { "TYA", 1, 1, 2, cpu_TYA  },           // 0x98 TYA  Transfer Index Y to Accumulator
-    { "STA", 3, 3, 5, cpu_STA_ABS_Y},       // 0x99 STA  Store Accumulator in Memory
-    { "TXS", 1, 1, 2, cpu_TXS  },           // 0x9A TXS  Transfer Index X to Stack Register
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x9B
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x9C
-    { "STA", 3, 3, 5, cpu_STA_ABS_X},       // 0x9D STA  Store Accumulator in Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x9E
-    { "---", 1, 1, 1, cpu_FIXME},           // 0x9F
-
-    { "LDY", 2, 2, 2, cpu_LDY  },           // 0xA0 LDY  Load Index Y with Memory
-    { "LDA", 2, 2, 6, cpu_LDA_IND_X},       // 0xA1 LDA  Load Accumulator with Memory
-    { "LDX", 2, 2, 2, cpu_LDX_IMM},         // 0xA2 LDX #
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xA3
-    { "LDY", 2, 2, 3, cpu_LDY_ZERO},        // 0xA4 LDY  Load Index Y with Memory
-    { "LDA", 2, 2, 3, cpu_LDA_ZERO},        // 0xA5 LDA  Load Accumulator with Memory
-	{ "LDX", 2, 2, 3, cpu_LDX_ZERO},        // 0xA6 LDX  Load Index X with Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xA7
-    { "TAY", 1, 1, 2, cpu_TAY  },           // 0xA8 TAY  Transfer Accumulator to Index Y
-    { "LDA", 2, 2, 2, cpu_LDA_IMM},         // 0xA9 LDA  Load Accumulator with Memory
-    { "TAX", 1, 1, 2, cpu_TAX  },           // 0xAA TAX  Transfer Accumulator to Index X
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xAB
-    { "LDY", 3, 3, 4, cpu_LDY_ABS},         // 0xAC LDY  Load index Y with memory
-    { "LDA", 3, 3, 4, cpu_LDA_ABS},         // 0xAD LDA  Load Accumulator with Memory
-    { "LDX", 3, 3, 4, cpu_LDX_ABS},         // 0xAE LDX  Load Index X with Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xAF
-
-    { "BCS", 2, 2, 2, cpu_BCS  },           // 0xB0 BCS  Branch on Carry Set
-    { "LDA", 2, 2, 5, cpu_LDA_IND_Y},       // 0xB1 LDA  Load Accumulator with Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xB2
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xB3
-    { "LDY", 2, 2, 4, cpu_LDY_ZERO_X},      // 0xB4 LDY  Load Index Y with Memory
-    { "LDA", 2, 2, 4, cpu_LDA_ZERO_X},      // 0xB5 LDA  Load Accumulator with Memory
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xB6
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xB7
-    { "CLV", 1, 1, 2, cpu_CLV  },           // 0xB8 CLV  Clear Overflow Flag
-    { "LDA", 3, 3, 4, cpu_LDA_ABS_Y},       // 0xB9 LDA  Load Accumulator with Memory
-    { "TSX", 1, 1, 2, cpu_TSX  },           // 0xBA TSX  Transfer Stack Pointer to Index X
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xBB
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xBC
-    { "LDA", 3, 3, 4, cpu_LDA_ABS_X},       // 0xBD LDA  Load Accumulator with Memory
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xBE
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xBF
-
-    { "CPY", 2, 2, 2, cpu_CPY_IMM},         // 0xC0 CPY  Compare Memory and Index Y
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xC1
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xC2
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xC3
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xC4
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xC5
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xC6
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xC7
-    { "INY", 1, 1, 2, cpu_INY  },           // 0xC8 INY  Increment Index Y by One
-    { "CMP", 2, 2, 2, cpu_CMP_IMM},         // 0xC9 CMP  Compare Memory with Accumulator
-    { "DEX", 1, 1, 2, cpu_DEX  },           // 0xCA DEX  Decrement Index X by One
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xCB
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xCC
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xCD
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xCE
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xCF
-
-    { "BNE", 2, 2, 2, cpu_BNE  },           // 0xD0 Branch on Result not Zero
-    { "CMP", 2, 2, 5, cpu_CMP_IND_Y},       // 0xD1 CMP Compare Memory with Accumulator
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xD2
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xD3
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xD4
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xD5
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xD6
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xD7
-    { "CLD", 1, 1, 2, cpu_CLD  },           // 0xD8 CLD  Clear Decimal Mode
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xD9
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xDA
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xDB
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xDC
-    { "CMP", 3, 3, 4, cpu_CMP_ABS_X},       // 0xDD CMP  Compare Memory with Accumulator
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xDE
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xDF
-
-    { "CPX", 2, 2, 2, cpu_CPX_IMM},         // 0xE0 CPX  Compare Memory and Index X
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xE1
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xE2
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xE3
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xE4
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xE5
-	{ "INC", 2, 2, 5, cpu_INC_ZERO},        // 0xE6 INC  Increment Memory by One
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xE7
-    { "INX", 1, 1, 2, cpu_INX  },           // 0xE8 INX  Increment Index X by One
-    { "SBC", 2, 2, 2, cpu_SBC_IMM},         // 0xE9 SBC  Subtract Memory from Accumulator with Borrow
-    { "NOP", 1, 1, 2, cpu_NOP  },           // 0xEA NOP
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xEB
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xEC
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xED
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xEE
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xEF
-
-    { "BEQ", 2, 2, 2, cpu_BEQ  },           // 0xF0 BEQ  Branch on Result Zero
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xF1
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xF2
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xF3
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xF4
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xF5
-	{ "---", 1, 1, 1, cpu_FIXME},           // 0xF6
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xF7
-    { "SED", 1, 1, 2, cpu_SED  },           // 0xF8 SED  Set Decimal Flag
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xF9
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xFA
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xFB
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xFC 
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xFD
-    { "---", 1, 1, 1, cpu_FIXME},           // 0xFE
-    { "---", 1, 1, 1, cpu_FIXME}            // 0xFF
- }; 
+// pacing: hold real speed, checked once per cpu_exec and per video frame in cpu_run
+static int      pacing;
+static uint64_t pace_cycle;
+static uint64_t pace_ns;
 
-void
-cpu_init  (double freq)
+static uint64_t
+cpu_nsec (void)
 {
-    cpu.freq = (freq ? freq : CPU_PAL_HZ);
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
 }
 
 void
-cpu_free (void)
+cpu_setPacing (int on)
 {
+    pacing     = on;
+    pace_cycle = cpu.cycle;
+    pace_ns    = cpu_nsec ();
 }
 
-void
-cpu_FIXME (char *message)
+static void
+cpu_pace (struct stats *s)
 {
-    printf ("<FIX THE OPCODE>\n");
-    cpu_dump (message ? message:ISA[cpu.IR].opcode);
-    printf ("</FIX THE OPCODE>\n"); 
+    uint64_t now = cpu_nsec ();
+    uint64_t due = pace_ns + (uint64_t)((cpu.cycle - pace_cycle) * 1e9 / cpu_freq);
 
-    if (!message) exit (EXIT_FAILURE);
+    if (due > now) {
+        struct timespec t = { (due - now) / 1000000000, (due - now) % 1000000000 };
+        nanosleep (&t, NULL);
+        stats_add (&s->sleep_ns, due - now);
+    } else {
+        // behind: start over from here, the lost time doesn't come back
+        stats_add (&s->overrun_ns, now - due);
+        pace_cycle = cpu.cycle;
+        pace_ns    = now;
+    }
 }
 
-void 
-cpu_addRom (uint16_t address, char* romfile, uint16_t offset)
+// one whole istruction with the selected core
+int
+cpu_istr (void)
 {
-    uint16_t count = 0;
-	printf ("Adding $%04X %s skipping first $%04X byte", address, romfile, offset);
+    int n;
 
-	if (g_file_test (romfile, G_FILE_TEST_EXISTS)) {
-    	FILE *file = fopen (romfile, "rb");
-        while (file) {
-        	unsigned char chread = fgetc (file);
+    if (core == CPU_CORE_CYCLE) {
+        do {
+            n = cpu_tick ();
+        } while (cpu.tcycle);
+        return n;
+    }
+    return cpu_step ();
+}
 
-        	if (feof (file)) break;
+// run (no trace) until at least 'cycles' more cycles are spent, always stop on
+// an istruction boundary. return the cycles really spent.
+// a breakpoint or watchpoint stops it early, debug_stop is set and debug_hit
+// tells why
+uint64_t
+cpu_exec (uint64_t cycles)
+{
+    uint64_t start = cpu.cycle;
+    uint64_t end   = cpu.cycle + cycles;
+    uint64_t t0    = cpu_nsec ();
+    uint64_t nist  = 0;
 
-            count++;
+    debug_stop = 0;
+    if (end > debug_cycle) end = debug_cycle;
 
-            if (offset < count) {
-        	   mem[address++] = chread;
-            }
+    if (core == CPU_CORE_CYCLE) {
+        while ((cpu.cycle < end && !debug_stop) || cpu.tcycle) {
+            nist += cpu_tick ();
+        }
+    } else {
+        while (cpu.cycle < end && !debug_stop) {
+            nist += cpu_step ();
         }
-        fclose (file);
+    }
 
-	} else {
-		printf (" ERROR! file not found");
-	}
-	printf ("\n");
-}
+    struct stats *s = stats_thread ();
+    if (pacing) cpu_pace (s);
+    stats_add (&s->istr, nist);
+    stats_add (&s->cycles, cpu.cycle - start);
+    stats_add (&s->run_ns, cpu_nsec () - t0);
+
+    debug_sync ();
+    if (!debug_stop && cpu.cycle >= debug_cycle) {
+        debug_hit.reason = DEBUG_CYCLE;
+        debug_hit.pc     = cpu.PC;
+        debug_hit.cycle  = cpu.cycle;
+        debug_cycle = UINT64_MAX;
+        debug_stop  = 1;
+    }
 
+    return cpu.cycle - start;
+}
 
-void
-cpu_run (void)
+// run until 'istr' istructions or 'cycles' more cycles are done (0: no
+// limit on that one) or a debug stop. trace 1 dumps every istruction before
+// it runs. returns the istructions done
+uint64_t
+cpu_run (uint64_t istr, uint64_t cycles, int trace)
 {
-  unsigned long int nloop = 11800; // CYCL 2595 ok
-  //long long int nloop = -1;
-  struct timespec now;
+    uint64_t nist   = 0;
+    uint64_t cycle0 = cpu.cycle;
+    uint64_t frame  = cpu.cycle;
+    uint64_t end    = (cycles ? cpu.cycle + cycles : UINT64_MAX);
+    struct stats *s = stats_thread ();
+    uint64_t t0     = cpu_nsec ();
 
-  while (nloop-- != 0) {
+    if (!istr) istr = UINT64_MAX;
 
-    // fetch and decode
-	  cpu.IR = mem[cpu.PC];
+    debug_stop = 0;
+    while (nist < istr && cpu.cycle < end) {
 
-    // DEBUG
-mem[0xD012] = 0;
-cpu_dump ("FD:");
-//debug_videodump();
+        // fetch and decode
+        cpu.IR = mem[cpu.PC];
+
+        // DEBUG
+        if (trace) cpu_dump (NULL);
+        //debug_videodump();
+
+        // execute
+        nist += cpu_istr ();
+        if (debug_stop) break;
 
-		// execute
-		ISA[cpu.IR].f ();
-		cpu.cycle += ISA[cpu.IR].clock;
-		cpu.PC += ISA[cpu.IR].pc_step;
-		
         // irq
-		//if (cpu_pending_irq) {
-		//	cpu_irq ();
-		//}
-/*
+        //if (cpu_pending_irq) {
+        //	cpu_irq ();
+        //}
+
         // time to sync
-        double trealhw = cpu.cycle * (1.0f / cpu.freq);
-        clock_gettime (CLOCK_REALTIME, &now); 
-        
-        double tspent  = (double)(now.tv_sec - cpu.starttime.tv_sec) + (double)(now.tv_nsec - cpu.starttime.tv_nsec)/(double)1000000000;
-        //printf ("time sp:%f rh:%f\n", tspent, trealhw);
-
-        while (tspent < trealhw) {
-            printf ("wait \n");
-            clock_gettime (CLOCK_REALTIME, &now); 
-            tspent  = (double)(now.tv_sec - cpu.starttime.tv_sec) + (double)(now.tv_nsec - cpu.starttime.tv_nsec)/(double)1000000000;
-            g_usleep (1);
+        if (pacing && cpu.cycle - frame >= cpu_frame) {
+            cpu_pace (s);
+            frame = cpu.cycle;
         }
-*/
-        // DEBUG EXECUTE
-        // cpu_dump ("E_:");
+    }
 
-	}
+    debug_sync ();
+    stats_add (&s->istr, nist);
+    stats_add (&s->cycles, cpu.cycle - cycle0);
+    stats_add (&s->run_ns, cpu_nsec () - t0);
+    return nist;
 }
 
 void
@@ -1503,8 +1908,12 @@ cpu_reset (void)
 	  cpu.SP     = 0xFD;       // implicit on 0x01 page
 	  cpu.P.P    = 0b00100100;
 
-    mem[0x0000] = 0x2F;
-    mem[0x0001] = 0x37;
+    // back to an opcode fetch, a polled interrupt is lost
+    cpu.tcycle = 0;
+    cpu.intr   = 0;
+
+    cpu_write (0x0000, 0x2F);
+    cpu_write (0x0001, 0x37);
 
 
     // https://github.com/Klaus2m5/6502_65C02_functional_tests
@@ -1520,51 +1929,28 @@ cpu_reset (void)
      mem[0x8007] = 0x38;
      mem[0x8008] = 0x30;
      */
-
-    clock_gettime (CLOCK_REALTIME, &cpu.starttime); 
 }
 
 void
-cpu_dump (char *message)
+cpu_dump (const char *message)
 {
+    char line[DISASM_LINE];
 
-    //printf ("%s", message);
-	//printf (" PC:%04X ", cpu.PC);
-    printf ("%04X", cpu.PC);
-
-    printf ("  %02X ", mem[cpu.PC+0]);    
-    if (ISA[cpu.IR].ist_len > 1) {
-        printf ("%02X ", mem[cpu.PC+1]);    
-    }  else {
-        printf ("   ");
-    }
-
-
-    if (ISA[cpu.IR].ist_len > 2) {    
-        printf ("%02X ", mem[cpu.PC+2]);    
-    } else {
-        printf ("   ");
-    }
-
-    printf (" (%c%c%c,%01i)", ISA[cpu.IR].opcode[0], ISA[cpu.IR].opcode[1], ISA[cpu.IR].opcode[2], ISA[cpu.IR].ist_len) ;
-
-    printf (" A:%02X", cpu.A);
-    printf (" X:%02X", cpu.X);
-    printf (" Y:%02X", cpu.Y);
-
-    printf (" SP:%02X", cpu.SP);
+    disasm_one (cpu.PC, DISASM_ADDR | DISASM_BYTES | DISASM_RESOLVE, line, sizeof (line));
 
-    printf (" P:%02X ", cpu.P.P);
-    printf ("%c", (cpu.P.N == 1 ? 'N':'n'));
-    printf ("%c", (cpu.P.V == 1 ? 'V':'v'));
-    printf ("%c", (cpu.P.X == 1 ? '-':'_'));
-    printf ("%c", (cpu.P.B == 1 ? 'B':'b'));
-    printf ("%c", (cpu.P.D == 1 ? 'D':'d'));
-    printf ("%c", (cpu.P.I == 1 ? 'I':'i'));
-    printf ("%c", (cpu.P.Z == 1 ? 'Z':'z'));
-    printf ("%c", (cpu.P.C == 1 ? 'C':'c'));
+    printf ("%-48sA:%02X X:%02X Y:%02X SP:%02X P:%02X %c%c%c%c%c%c%c%c CYC:%lu\n", line,
+            cpu.A, cpu.X, cpu.Y, cpu.SP, cpu.P.P,
+            (cpu.P.N == 1 ? 'N':'n'),
+            (cpu.P.V == 1 ? 'V':'v'),
+            (cpu.P.X == 1 ? '-':'_'),
+            (cpu.P.B == 1 ? 'B':'b'),
+            (cpu.P.D == 1 ? 'D':'d'),
+            (cpu.P.I == 1 ? 'I':'i'),
+            (cpu.P.Z == 1 ? 'Z':'z'),
+            (cpu.P.C == 1 ? 'C':'c'),
+            (unsigned long)cpu.cycle);
 
-    printf (" CYC:%lu\n", cpu.cycle);
+    if (message) printf ("%s\n", message);
 }
 
 //D01C  AD 00 02  LDA $0200 = AA                  A:AD X:00 Y:69 P:A5 SP:FB PPU: 86, 23 CYC:2650
@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <time.h>
 
+#include "debug.h"
+
 // https://www.ktverkko.fi/~msmakela/8bit/cbm.html
 // http://www.oxyron.de/html/opcodes02.html
 // http://archive.6502.org/datasheets/mos_6510_mpu.pdf
@@ -39,16 +41,48 @@
 #define CPU_PAL_HZ  ( 985248.611111111)
 #define CPU_NTSC_HZ (1022727.142857143)
 
-struct Tcpu {
-	// cpu freq
-	double freq;
+// cycles per video frame, 63 x 312 lines PAL, 65 x 263 lines NTSC
+#define CPU_PAL_FRAME  19656
+#define CPU_NTSC_FRAME 17095
+
+// execution core
+// both run the same handlers, made of one step per bus cycle: every read and
+// write lands on its own cycle (cpu.cycle at the access), with either core
+// FAST  : instruction stepped, all the bus cycles of an opcode in one call
+// CYCLE : cycle stepped, one bus cycle per cpu_tick, devices can act between
+//         any two (build with -DCPU_CYCLE_STEPPED to make it the default)
+enum cpu_core {
+	CPU_CORE_FAST,
+	CPU_CORE_CYCLE
+};
 
+#ifdef CPU_CYCLE_STEPPED
+#define CPU_CORE_DEFAULT CPU_CORE_CYCLE
+#else
+#define CPU_CORE_DEFAULT CPU_CORE_FAST
+#endif
+
+// the register file, all a core touches on every istruction. one cache line of
+// its own: nothing else written next to it
+struct Tcpu {
 	// internal state
 	uint64_t cycle;
 
-	// start time
-	struct timespec starttime; 
-	
+	// bus cycle inside the current istruction (0 = opcode fetch), non zero
+	// only between cpu_tick calls
+	uint8_t tcycle;
+
+	// latches, what a bus cycle leaves to the next one
+	uint8_t  ptr;       // zero page pointer
+	uint8_t  data;      // byte read
+	uint8_t  carry;     // the index crossed a page, the high byte is still to fix
+	uint16_t ea;        // effective address
+
+	// irq line (cpu_irq), and the interrupt polled on the last cycle of the
+	// istruction: taken before the next fetch
+	uint8_t irq;
+	uint8_t intr;
+
 	// istruction register
 	uint8_t IR;
 
@@ -84,21 +118,265 @@ struct Tcpu {
 			uint8_t  PCH;	
 		};
 	};
+} __attribute__ ((aligned (64)));
+
+// 64 KiB address space
+#define CPU_MEMSIZE 0x10000
+
+// loaded rom images, identified by content hash
+#define CPU_MAXROM 8
+
+struct cpu_rom {
+	uint16_t address;
+	uint32_t len;
+	uint64_t hash;
 };
 
 extern struct Tcpu cpu;
-extern uint8_t mem[0xFFFF];
+
+// cpu freq, see cpu_init
+extern double cpu_freq;
+
+// cycles per video frame for that clock: NTSC when it is nearer the NTSC one
+extern uint32_t cpu_frame;
+extern uint8_t mem[CPU_MEMSIZE];
+
+extern struct cpu_rom cpu_roms[CPU_MAXROM];
+extern int            cpu_nroms;
+
+// 256 byte pages written since the last state_rewindCapture
+extern uint8_t mem_dirty[CPU_MEMSIZE >> 8];
+
+// 256 byte pages mapped from a shared read only rom (see cpu_mapRom)
+extern uint8_t mem_rom[CPU_MEMSIZE >> 8];
+
+// no vic yet, the raster is always on line 0: loads of $D012 read 0, stores
+// land in memory as usual
+#define CPU_RASTER 0xD012
+
+// a byte as the cpu would load it, no watchpoint
+static inline uint8_t
+cpu_peek (uint16_t address)
+{
+	return (address == CPU_RASTER ? 0 : mem[address]);
+}
+
+// every data load the cpu does goes through here (not the opcode and operand fetch)
+static inline uint8_t
+cpu_read (uint16_t address)
+{
+	uint8_t value = cpu_peek (address);
+
+#ifndef CPU_NODEBUG
+	if (debug_page[address >> 8] & DEBUG_READ) debug_access (address, DEBUG_READ, value);
+#endif
+	return value;
+}
+
+// every store the cpu does goes through here
+static inline void
+cpu_write (uint16_t address, uint8_t value)
+{
+#ifndef CPU_NODEBUG
+	if (debug_page[address >> 8] & DEBUG_WRITE) debug_access (address, DEBUG_WRITE, value);
+#endif
+	if (mem_rom[address >> 8]) return;
+
+	mem[address] = value;
+	mem_dirty[address >> 8] = 1;
+}
+
+// stack, page 1. SP is the next free byte and wraps inside the page
+#define CPU_STACK 0x0100
+
+static inline void
+cpu_push (uint8_t value)
+{
+#ifndef CPU_NODEBUG
+	if (debug_stackOn && cpu.SP <= debug_stackLow) debug_stackFault (cpu.SP ? DEBUG_STACK_DEPTH : DEBUG_STACK_OVERFLOW);
+#endif
+	cpu_write (CPU_STACK + cpu.SP--, value);
+}
+
+static inline uint8_t
+cpu_pull (void)
+{
+#ifndef CPU_NODEBUG
+	if (debug_stackOn && cpu.SP == 0xFF) debug_stackFault (DEBUG_STACK_UNDERFLOW);
+#endif
+	return cpu_read (CPU_STACK + ++cpu.SP);
+}
+
+// the byte by byte path: a pair that wraps, stack checks, watchpoints or a rom on page 1
+#ifndef CPU_NODEBUG
+#define CPU_STACK_SLOW(kind) (debug_stackOn || (debug_page[CPU_STACK >> 8] & (kind)))
+#else
+#define CPU_STACK_SLOW(kind) 0
+#endif
+
+// return addresses, high byte first as JSR does: little endian in memory, on
+// a little endian host the fast path is a single 16 bit load / store
+static inline void
+cpu_push16 (uint16_t value)
+{
+	if (cpu.SP == 0 || CPU_STACK_SLOW (DEBUG_WRITE) || mem_rom[CPU_STACK >> 8]) {
+		cpu_push (value >> 8);
+		cpu_push (value & 0xFF);
+		return;
+	}
+
+	uint8_t *s = &mem[CPU_STACK + cpu.SP - 1];
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	__builtin_memcpy (s, &value, 2);
+#else
+	s[0] = value & 0xFF;
+	s[1] = value >> 8;
+#endif
+	mem_dirty[CPU_STACK >> 8] = 1;
+	cpu.SP -= 2;
+}
+
+static inline uint16_t
+cpu_pull16 (void)
+{
+	if (cpu.SP >= 0xFE || CPU_STACK_SLOW (DEBUG_READ)) {
+		uint8_t lo = cpu_pull ();
+		return lo | (cpu_pull () << 8);
+	}
+
+	const uint8_t *s = &mem[CPU_STACK + cpu.SP + 1];
+	cpu.SP += 2;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint16_t value;
+	__builtin_memcpy (&value, s, 2);
+	return value;
+#else
+	return s[0] | (s[1] << 8);
+#endif
+}
 
 extern void cpu_init  (double frq);
 extern void cpu_free  (void);
 
-extern void cpu_addRom (uint16_t address, char* romfile, uint16_t offset);
+// errors
+enum cpu_err {
+	CPU_OK      =  0,
+	CPU_ENOENT  = -1,   // can't open the file
+	CPU_EIO     = -2,   // read failed
+	CPU_ESIZE   = -3,   // empty or doesn't fit in memory at the given address
+	CPU_EFORMAT = -4,   // bad or unsupported header
+	CPU_EROM    = -5,   // target overlaps a shared read only rom
+	CPU_EFULL   = -6,   // no room left in a fixed table
+	CPU_ESTATE  = -7,   // the machine is not where it should be (i.e. not at READY)
+	CPU_ENOMEM  = -8    // out of memory
+};
+
+// image formats
+enum cpu_imgfmt {
+	CPU_IMG_AUTO,       // from the file extension, .prg .nes or raw
+	CPU_IMG_RAW,
+	CPU_IMG_PRG,        // 2 byte load address, then data
+	CPU_IMG_NES         // iNES header, PRG ROM banks
+};
+
+// cpu_loadImage address: the one in the header (PRG load address, NES bank
+// layout). a raw image has none
+#define CPU_IMG_HEADER (-1)
+
+extern int  cpu_loadImage (const char *file, enum cpu_imgfmt fmt, int address, uint32_t offset, uint16_t *start, uint32_t *len);
+extern int  cpu_addRom (uint16_t address, const char *romfile, uint16_t offset);
+extern int  cpu_mapRom (uint16_t address, const char *romfile);
+extern void cpu_unmapRoms (void);
+extern void cpu_memLoad (const uint8_t *image);
+extern const char *cpu_strerror (int err);
+
 extern void cpu_reset (void);
-extern void cpu_run   (void);
+extern uint64_t cpu_run (uint64_t istr, uint64_t cycles, int trace);
+
+extern void     cpu_setCore (enum cpu_core core);
+// each returns the istructions completed: 0 or 1 (traps, execute breakpoints
+// and the interrupt sequence don't count)
+extern int      cpu_step    (void);
+extern int      cpu_tick    (void);
+extern int      cpu_istr    (void);
+extern uint64_t cpu_exec    (uint64_t cycles);
+
+// drive the irq line: non zero holds it low (level triggered, as the cia / vic
+// do). taken after the istruction that polls it with I clear
+extern void     cpu_irq     (int level);
+
+// cpu.intr
+#define CPU_INTR_PENDING 1      // polled, taken before the next fetch
+#define CPU_INTR_SEQ     2      // running the 7 cycles of the interrupt sequence
+
+// hold real speed (cpu_freq), sleeping when ahead
+extern void     cpu_setPacing (int on);
+
+extern uint64_t cpu_hash (const uint8_t *data, uint32_t len, uint64_t hash);
+
+// pc traps
+// f runs instead of fetching the istruction at pc. it returns non zero when it
+// did the job itself (registers, PC and cycles updated), 0 to execute as usual
+#define CPU_MAXTRAP 32
+
+typedef int (*cpu_trap_f) (void);
+
+extern uint8_t cpu_trapPage[CPU_MEMSIZE >> 8];
+
+extern int cpu_setTrap (uint16_t pc, cpu_trap_f f);
+extern int cpu_trap    (void);
+
+// addressing modes, as in ISA[].mode. the operand length follows from it
+enum cpu_mode {
+	CPU_AM_IMP,         // implied
+	CPU_AM_ACC,         // A
+	CPU_AM_IMM,         // #$nn
+	CPU_AM_ZP,          // $nn
+	CPU_AM_ZPX,         // $nn,X
+	CPU_AM_ZPY,         // $nn,Y
+	CPU_AM_ABS,         // $nnnn
+	CPU_AM_ABSX,        // $nnnn,X
+	CPU_AM_ABSY,        // $nnnn,Y
+	CPU_AM_IND,         // ($nnnn)
+	CPU_AM_INDX,        // ($nn,X)
+	CPU_AM_INDY,        // ($nn),Y
+	CPU_AM_REL          // branch target
+};
+
+// bytes an istruction takes with its operand
+#define CPU_AM_LEN(m) ((m) == CPU_AM_IMP || (m) == CPU_AM_ACC ? 1 : ((m) >= CPU_AM_ABS && (m) <= CPU_AM_IND) ? 3 : 2)
+
+// opcode table, generated from isa.h. "---" is not implemented (the
+// undocumented opcodes).
+// 8 bytes an entry, a cache line holds 8 opcodes. the cores don't read it:
+// they have the handlers in cpu_op and clock / step in cpu_opTiming, the one
+// place those two live
+struct isa_t {
+	char opcode[3];
+	uint8_t ist_len;
+	uint8_t mode;
+} __attribute__ ((aligned (8)));
+
+extern const struct isa_t ISA[256];
+
+// 'one' non zero: run the bus cycle cpu.tcycle only (cycle core), else all of
+// them from there to the end of the istruction
+typedef void (*cpu_op_f) (int one);
+
+extern const cpu_op_f cpu_op[256];
+
+struct cpu_timing {
+	uint8_t clock;
+	uint8_t step;
+};
+
+extern const struct cpu_timing cpu_opTiming[256];
 
 // DEBUG
-extern void cpu_dump  (char *message);
-extern void cpu_FIXME (char *message);
+// the istruction at PC and the registers, then message on a line of its own
+// (NULL: none)
+extern void cpu_dump  (const char *message);
+extern void cpu_FIXME (const char *message);
 
 
 union cpu_addr {
@@ -109,7 +387,5 @@ union cpu_addr {
 	};
 };
 
-extern const char PETSCII[255];
-
 #endif // CPU_H
 
@@ -0,0 +1,400 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "cpu.h"
+#include "kernal.h"
+#include "net.h"
+#include "petscii.h"
+#include "state.h"
+#include "daemon.h"
+
+struct daemon_buf {
+    char  *data;
+    size_t len;
+    size_t size;
+};
+
+static volatile sig_atomic_t quit;
+
+static uint8_t *warm;
+static size_t   warm_len;
+
+static uint64_t
+daemon_nsec (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// printf at the end of the reply
+static void
+daemon_printf (struct daemon_buf *b, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+static void
+daemon_printf (struct daemon_buf *b, const char *fmt, ...)
+{
+    va_list ap;
+
+    for (;;) {
+        size_t room = b->size - b->len;
+
+        va_start (ap, fmt);
+        int n = vsnprintf (b->data + b->len, room, fmt, ap);
+        va_end (ap);
+        if (n < 0) return;
+
+        if ((size_t)n < room) {
+            b->len += n;
+            return;
+        }
+
+        size_t size = (b->size ? b->size * 2 : DAEMON_LINE);
+        while (size - b->len <= (size_t)n) size *= 2;
+
+        char *data = realloc (b->data, size);
+        if (!data) return;
+        b->data = data;
+        b->size = size;
+    }
+}
+
+// decimal, $hex or 0xhex
+static int
+daemon_num (const char *s, unsigned long long *value)
+{
+    char *end;
+    int   base = 10;
+
+    if (*s == '$') {
+        s++;
+        base = 16;
+    } else if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        s += 2;
+        base = 16;
+    }
+    if (!*s) return 0;
+
+    errno = 0;
+    *value = strtoull (s, &end, base);
+    return (!*end && !errno);
+}
+
+static int
+daemon_addr (const char *s, uint16_t *address)
+{
+    unsigned long long v;
+
+    if (!daemon_num (s, &v) || v >= CPU_MEMSIZE) return 0;
+    *address = v;
+    return 1;
+}
+
+static const char *
+daemon_stopName (int ready)
+{
+    if (ready) return "ready";
+    if (!debug_stop) return "budget";
+
+    switch (debug_hit.reason) {
+    case DEBUG_HIT:   return "pc";
+    case DEBUG_FIXME: return "fixme";
+    case DEBUG_STACK: return "stack";
+    default:          return "host";
+    }
+}
+
+// one RUN. ERR on a bad request, the machine is back to warm anyway
+static void
+daemon_run (char *args, uint64_t arrived, struct daemon_buf *out)
+{
+    const char *id = NULL, *prg = NULL;
+    uint16_t    sys = 0, until = 0;
+    int         has_sys = 0, has_until = 0, ready = 0, screen = 0, nmem = 0;
+    uint64_t    cycles = DAEMON_CYCLES;
+    struct { uint16_t from, to; } memr[DAEMON_MAXMEM];
+    char       *save, *tok;
+    uint64_t    t0 = daemon_nsec ();
+
+    for (tok = strtok_r (args, " \t", &save); tok; tok = strtok_r (NULL, " \t", &save)) {
+        char *value = strchr (tok, '=');
+        unsigned long long n;
+
+        if (value) *value++ = '\0';
+
+        if (!strcmp (tok, "id") && value) {
+            id = value;
+        } else if (!strcmp (tok, "prg") && value) {
+            prg = value;
+        } else if (!strcmp (tok, "sys") && value && daemon_addr (value, &sys)) {
+            has_sys = 1;
+        } else if (!strcmp (tok, "until") && value && daemon_addr (value, &until)) {
+            has_until = 1;
+        } else if (!strcmp (tok, "cycles") && value && daemon_num (value, &n)) {
+            cycles = n;
+        } else if (!strcmp (tok, "ready") && !value) {
+            ready = 1;
+        } else if (!strcmp (tok, "screen") && !value) {
+            screen = 1;
+        } else if (!strcmp (tok, "mem") && value && nmem < DAEMON_MAXMEM) {
+            char *to = strchr (value, '-');
+
+            if (to) *to++ = '\0';
+            if (!daemon_addr (value, &memr[nmem].from) || !daemon_addr (to ? to : value, &memr[nmem].to) ||
+                memr[nmem].to < memr[nmem].from) {
+                daemon_printf (out, "ERR bad range %s\nEND\n", value);
+                return;
+            }
+            nmem++;
+        } else {
+            daemon_printf (out, "ERR bad argument %s\nEND\n", tok);
+            return;
+        }
+    }
+
+    state_load (warm, warm_len);
+    debug_clear ();
+    debug_fixmeCheck (1);
+    debug_stackCheck (1, 0);
+
+    if (prg) {
+        int err;
+
+        if (kernal_isReady ()) {
+            err = kernal_loadPrg (prg, (has_sys ? KERNAL_RUN_SYS : KERNAL_RUN_BASIC), sys);
+        } else {
+            err = cpu_loadImage (prg, CPU_IMG_PRG, CPU_IMG_HEADER, 0, NULL, NULL);
+            if (has_sys) cpu.PC = sys;
+        }
+        if (err != CPU_OK) {
+            daemon_printf (out, "ERR %s: %s\nEND\n", prg, cpu_strerror (err));
+            return;
+        }
+    } else if (has_sys && kernal_sys (sys) != CPU_OK) {
+        cpu.PC = sys;
+    }
+    if (has_until) debug_break (until);
+
+    // a frame at a time, READY is checked in between. a budget past the end of
+    // time is no budget
+    uint64_t start = cpu.cycle;
+    uint64_t end   = (cycles > UINT64_MAX - cpu.cycle ? UINT64_MAX : cpu.cycle + cycles);
+    int      at_ready = 0;
+
+    debug_stop = 0;
+    while (cpu.cycle < end) {
+        cpu_exec (end - cpu.cycle < cpu_frame ? end - cpu.cycle : cpu_frame);
+        if (debug_stop) break;
+        if (ready && kernal_isReady ()) {
+            at_ready = 1;
+            break;
+        }
+    }
+
+    uint64_t t1 = daemon_nsec ();
+    daemon_printf (out, "OK%s%s stop=%s cycles=%lu us=%lu wait_us=%lu\n", (id ? " id=" : ""), (id ? id : ""),
+                   daemon_stopName (at_ready), (unsigned long)(cpu.cycle - start),
+                   (unsigned long)((t1 - t0) / 1000), (unsigned long)((t0 - arrived) / 1000));
+
+    if (screen) {
+        char text[PETSCII_SCREEN_MAX];
+        char *row = text, *nl;
+
+        petscii_screen (text, sizeof (text));
+        while ((nl = strchr (row, '\n'))) {
+            *nl = '\0';
+            daemon_printf (out, "SCREEN %s\n", row);
+            row = nl + 1;
+        }
+    }
+
+    for (int i = 0; i < nmem; i++) {
+        daemon_printf (out, "MEM $%04X ", memr[i].from);
+        for (uint32_t a = memr[i].from; a <= memr[i].to; a++) {
+            daemon_printf (out, "%02X", mem[a]);
+        }
+        daemon_printf (out, "\n");
+    }
+    daemon_printf (out, "END\n");
+}
+
+// 0 to close the connection
+static int
+daemon_line (char *line, uint64_t arrived, struct daemon_buf *out)
+{
+    char *cmd = line + strspn (line, " \t");
+    size_t n  = strcspn (cmd, " \t");
+
+    if (!n) return 1;
+
+    if (n == 3 && !strncmp (cmd, "RUN", 3)) {
+        daemon_run (cmd + n, arrived, out);
+    } else if (n == 4 && !strncmp (cmd, "PING", 4)) {
+        daemon_printf (out, "OK\nEND\n");
+    } else if (n == 4 && !strncmp (cmd, "QUIT", 4)) {
+        return 0;
+    } else {
+        daemon_printf (out, "ERR unknown command\nEND\n");
+    }
+    return 1;
+}
+
+static int
+daemon_send (int fd, const struct daemon_buf *out)
+{
+    for (size_t sent = 0; sent < out->len; ) {
+        ssize_t n = send (fd, out->data + sent, out->len - sent, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        sent += n;
+    }
+    return 0;
+}
+
+// every whole line read is run, the replies go out together
+static void
+daemon_conn (int fd)
+{
+    static char in[DAEMON_LINE];
+    struct daemon_buf out = { NULL, 0, 0 };
+    size_t have = 0;
+    int    open = 1;
+
+    while (open) {
+        ssize_t n = recv (fd, in + have, sizeof (in) - have, 0);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        uint64_t arrived = daemon_nsec ();
+        char *line = in, *nl;
+
+        have += n;
+        while (open && (nl = memchr (line, '\n', in + have - line))) {
+            *nl = '\0';
+            if (nl > line && nl[-1] == '\r') nl[-1] = '\0';
+
+            open = daemon_line (line, arrived, &out);
+            line = nl + 1;
+        }
+
+        have -= line - in;
+        memmove (in, line, have);
+        if (have == sizeof (in)) {
+            daemon_printf (&out, "ERR line too long\nEND\n");
+            have = 0;
+        }
+
+        if (daemon_send (fd, &out)) break;
+        out.len = 0;
+    }
+
+    free (out.data);
+    close (fd);
+}
+
+static void
+daemon_worker (int lfd)
+{
+    for (;;) {
+        int fd = accept (lfd, NULL, NULL);
+
+        if (fd < 0 && errno == EINTR) continue;
+        if (fd < 0) break;
+        daemon_conn (fd);
+    }
+}
+
+static pid_t
+daemon_spawn (int lfd)
+{
+    pid_t pid = state_fork ();
+
+    if (pid == 0) {
+        signal (SIGINT, SIG_DFL);
+        signal (SIGTERM, SIG_DFL);
+        daemon_worker (lfd);
+        _exit (EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+void
+daemon_stop (void)
+{
+    quit = 1;
+}
+
+int
+daemon_serve (const char *path, int workers)
+{
+    char  unix_path[sizeof (((struct sockaddr_un *)0)->sun_path)];
+    pid_t pids[DAEMON_MAXWORKER];
+    int   lfd;
+
+    if (workers < 1 || workers > DAEMON_MAXWORKER) return CPU_ESIZE;
+
+    warm_len = state_size ();
+    if (!(warm = malloc (warm_len))) return CPU_ENOMEM;
+    state_save (warm, warm_len);
+
+    // workers block in accept, a path only
+    if ((lfd = net_listen (path, 64, 0, unix_path, sizeof (unix_path))) < 0) {
+        free (warm);
+        return lfd;
+    }
+
+    quit = 0;
+    for (int i = 0; i < workers; i++) {
+        pids[i] = daemon_spawn (lfd);
+    }
+
+    while (!quit) {
+        pid_t pid = wait (NULL);
+
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < workers; i++) {
+            if (pids[i] == pid && !quit) pids[i] = daemon_spawn (lfd);
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) kill (pids[i], SIGTERM);
+    }
+    while (wait (NULL) > 0 || errno == EINTR);
+
+    net_close (lfd, unix_path);
+    free (warm);
+    warm = NULL;
+    return CPU_OK;
+}
@@ -0,0 +1,68 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+
+// job server on a unix socket
+//
+// the machine as the caller left it (booted, roms loaded, traps set, at READY
+// for prg=, sys= and ready to go through the kernal) is the warm machine: it is kept as a snapshot and 'workers' processes are forked
+// from it (state_fork, pages shared copy on write). the workers accept on the
+// same socket, a connection stays with one worker. every job starts from the
+// warm snapshot, so jobs don't see each other.
+// one request a line. replies come back in order, a client can send many
+// requests without waiting for the replies (pipelining).
+//
+//   RUN [id=x] [prg=file] [sys=$c000] [cycles=n] [until=$e5cd] [ready] [screen] [mem=$0400-$07e7]...
+//       prg     .prg at its load address. at READY BASIC pointers are set and
+//               it's RUN (kernal_loadPrg)
+//       sys     start there: a SYS at READY, a jump otherwise
+//       cycles  budget, DAEMON_CYCLES if not given
+//       until   stop when PC gets there
+//       ready   stop at READY
+//       screen  reply with the text screen
+//       mem     reply with a memory range, inclusive (up to DAEMON_MAXMEM)
+//   PING
+//   QUIT        close the connection
+//
+// numbers are decimal, $hex or 0xhex. a reply is
+//
+//   OK id=x stop=budget|pc|ready|fixme|stack cycles=n us=n wait_us=n
+//   SCREEN <row>                   25 of them
+//   MEM $0400 2008...              hex bytes
+//   END
+//
+// or ERR <why> and END. us is the time the job took, wait_us the time its
+// line waited behind the ones before it.
+// an opcode not implemented stops the job (debug_fixmeCheck), never the
+// worker. so does the stack wrapping (debug_stackCheck, stop=stack)
+
+#define DAEMON_MAXWORKER 64
+#define DAEMON_MAXMEM    16
+#define DAEMON_LINE      4096
+#define DAEMON_CYCLES    982800      // 50 PAL frames, a second
+
+// snapshot the machine, fork the workers, then wait: a worker that dies is
+// replaced. returns (a cpu_err) after daemon_stop, the workers are killed
+extern int  daemon_serve (const char *path, int workers);
+
+// from a signal handler, installed without SA_RESTART
+extern void daemon_stop  (void);
+
+#endif // DAEMON_H
@@ -0,0 +1,270 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <string.h>
+
+#include "cpu.h"
+#include "debug.h"
+
+struct debug_point {
+    uint16_t from;
+    uint16_t to;
+    uint8_t  kind;      // 0 = free slot
+    uint8_t  reg;
+    uint8_t  value;
+};
+
+uint8_t debug_page[256];
+volatile sig_atomic_t debug_stop;
+volatile sig_atomic_t debug_host;
+
+struct debug_hit debug_hit;
+
+uint64_t debug_cycle = UINT64_MAX;
+
+uint8_t debug_stackOn;
+uint8_t debug_stackLow;
+
+uint8_t debug_fixmeOn;
+
+static struct debug_point points[DEBUG_MAXPOINT];
+
+static void
+debug_rebuild (void)
+{
+    memset (debug_page, 0, sizeof (debug_page));
+
+    for (int i = 0; i < DEBUG_MAXPOINT; i++) {
+        if (!points[i].kind) continue;
+        for (int p = points[i].from >> 8; p <= points[i].to >> 8; p++) {
+            debug_page[p] |= points[i].kind;
+        }
+    }
+}
+
+int
+debug_watch (uint16_t from, uint16_t to, uint8_t kind)
+{
+    kind &= DEBUG_READ | DEBUG_WRITE | DEBUG_EXEC;
+    if (!kind || from > to) return CPU_ESIZE;
+
+    for (int i = 0; i < DEBUG_MAXPOINT; i++) {
+        if (points[i].kind) continue;
+
+        points[i].from  = from;
+        points[i].to    = to;
+        points[i].kind  = kind;
+        points[i].reg   = DEBUG_REG_NONE;
+        points[i].value = 0;
+
+        debug_rebuild ();
+        return i;
+    }
+
+    return CPU_EFULL;
+}
+
+int
+debug_break (uint16_t pc)
+{
+    return debug_watch (pc, pc, DEBUG_EXEC);
+}
+
+int
+debug_cond (int id, enum debug_reg reg, uint8_t value)
+{
+    if (id < 0 || id >= DEBUG_MAXPOINT || !points[id].kind) return CPU_ENOENT;
+
+    points[id].reg   = reg;
+    points[id].value = value;
+    return CPU_OK;
+}
+
+int
+debug_delete (int id)
+{
+    if (id < 0 || id >= DEBUG_MAXPOINT || !points[id].kind) return CPU_ENOENT;
+
+    points[id].kind = 0;
+    debug_rebuild ();
+    return CPU_OK;
+}
+
+void
+debug_clear (void)
+{
+    memset (points, 0, sizeof (points));
+    memset (debug_page, 0, sizeof (debug_page));
+    debug_cycle   = UINT64_MAX;
+    debug_stackOn = 0;
+    debug_fixmeOn = 0;
+
+    // a stop from the last run would let its istruction through (resume)
+    memset (&debug_hit, 0, sizeof (debug_hit));
+    debug_hit.reason = DEBUG_RUN;
+}
+
+void
+debug_stackCheck (int on, uint8_t low)
+{
+    debug_stackOn  = (on != 0);
+    debug_stackLow = low;
+}
+
+void
+debug_fixmeCheck (int on)
+{
+    debug_fixmeOn = (on != 0);
+}
+
+void
+debug_breakCycle (uint64_t cycle)
+{
+    debug_cycle = cycle;
+}
+
+void
+debug_resume (void)
+{
+    debug_hit.reason = DEBUG_HIT;
+    debug_hit.kind   = DEBUG_EXEC;
+    debug_hit.pc     = cpu.PC;
+    debug_hit.cycle  = cpu.cycle;
+}
+
+// async signal safe: sig_atomic_t stores only, debug_sync fills in debug_hit
+void
+debug_interrupt (void)
+{
+    debug_host = 1;
+    debug_stop = 1;
+}
+
+void
+debug_sync (void)
+{
+    if (!debug_host) return;
+    debug_host = 0;
+
+    // a stop cleared since (a new run) drops it, as it always did
+    if (!debug_stop) return;
+
+    debug_hit.reason = DEBUG_HOST;
+    debug_hit.kind   = 0;
+    debug_hit.id     = -1;
+    debug_hit.pc     = cpu.PC;
+    debug_hit.cycle  = cpu.cycle;
+}
+
+static int
+debug_match (const struct debug_point *p, uint16_t address, uint8_t kind)
+{
+    if (!(p->kind & kind) || address < p->from || address > p->to) return 0;
+
+    switch (p->reg) {
+        case DEBUG_REG_A:  return cpu.A   == p->value;
+        case DEBUG_REG_X:  return cpu.X   == p->value;
+        case DEBUG_REG_Y:  return cpu.Y   == p->value;
+        case DEBUG_REG_SP: return cpu.SP  == p->value;
+        case DEBUG_REG_P:  return cpu.P.P == p->value;
+        default:           return 1;
+    }
+}
+
+static void
+debug_fire (int id, uint16_t address, uint8_t kind, uint8_t value)
+{
+    debug_hit.reason  = DEBUG_HIT;
+    debug_hit.kind    = kind;
+    debug_hit.id      = id;
+    debug_hit.pc      = cpu.PC;
+    debug_hit.address = address;
+    debug_hit.value   = value;
+    debug_hit.cycle   = cpu.cycle;
+
+    debug_stop = 1;
+}
+
+// read / write: the istruction completes, cpu_exec stops after it.
+// the first hit wins
+void
+debug_access (uint16_t address, uint8_t kind, uint8_t value)
+{
+    if (debug_stop) return;
+
+    for (int i = 0; i < DEBUG_MAXPOINT; i++) {
+        if (debug_match (&points[i], address, kind)) {
+            debug_fire (i, address, kind, value);
+            return;
+        }
+    }
+}
+
+// execute: stop before the fetch, return non zero to skip it. run again from
+// the same pc and cycle and the point lets it through, so resume just works
+int
+debug_exec (void)
+{
+    if (debug_hit.reason == DEBUG_HIT && debug_hit.kind == DEBUG_EXEC &&
+        debug_hit.pc == cpu.PC && debug_hit.cycle == cpu.cycle) {
+        debug_hit.reason = DEBUG_RUN;
+        return 0;
+    }
+
+    for (int i = 0; i < DEBUG_MAXPOINT; i++) {
+        if (debug_match (&points[i], cpu.PC, DEBUG_EXEC)) {
+            debug_fire (i, cpu.PC, DEBUG_EXEC, mem[cpu.PC]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// the istruction completes (SP wraps as on the real thing), cpu_exec stops
+// after it. cpu.PC is still the istruction, the handlers move it last
+void
+debug_stackFault (uint8_t kind)
+{
+    if (debug_stop) return;
+
+    debug_hit.reason  = DEBUG_STACK;
+    debug_hit.kind    = kind;
+    debug_hit.id      = -1;
+    debug_hit.pc      = cpu.PC;
+    debug_hit.address = CPU_STACK + cpu.SP;
+    debug_hit.value   = cpu.SP;
+    debug_hit.cycle   = cpu.cycle;
+
+    debug_stop = 1;
+}
+
+// as debug_stackFault: the handler goes on with whatever it does after
+// cpu_FIXME, cpu_exec stops after the istruction
+void
+debug_fixme (void)
+{
+    if (debug_stop) return;
+
+    debug_hit.reason  = DEBUG_FIXME;
+    debug_hit.kind    = 0;
+    debug_hit.id      = -1;
+    debug_hit.pc      = cpu.PC;
+    debug_hit.address = cpu.PC;
+    debug_hit.value   = cpu.IR;
+    debug_hit.cycle   = cpu.cycle;
+
+    debug_stop = 1;
+}
@@ -0,0 +1,120 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <stdint.h>
+#include <signal.h>
+
+// breakpoints and watchpoints
+//
+// every point covers an address range and any of read, write, execute. the
+// pages it touches are flagged in debug_page, cpu_read / cpu_write and the
+// istruction fetch only call in here when the page flag is set. a hit stops
+// cpu_exec on the next istruction boundary, the why is in debug_hit.
+// build with -DCPU_NODEBUG to compile the checks out
+
+#define DEBUG_READ  1
+#define DEBUG_WRITE 2
+#define DEBUG_EXEC  4
+
+#define DEBUG_MAXPOINT 32
+
+// a point can fire only when a register holds a value
+enum debug_reg {
+	DEBUG_REG_NONE,
+	DEBUG_REG_A,
+	DEBUG_REG_X,
+	DEBUG_REG_Y,
+	DEBUG_REG_SP,
+	DEBUG_REG_P
+};
+
+// why cpu_exec stopped
+enum debug_reason {
+	DEBUG_RUN,          // didn't
+	DEBUG_HIT,          // a point, see kind and id
+	DEBUG_CYCLE,        // debug_breakCycle
+	DEBUG_HOST,         // debug_interrupt
+	DEBUG_STACK,        // debug_stackCheck, kind is the fault
+	DEBUG_FIXME         // debug_fixmeCheck, value is the opcode
+};
+
+// stack faults
+enum debug_stack {
+	DEBUG_STACK_OVERFLOW = 1,   // push with SP at 0x00, wraps to 0xFF
+	DEBUG_STACK_UNDERFLOW,      // pull with SP at 0xFF, wraps to 0x00
+	DEBUG_STACK_DEPTH           // push at or below the low mark, runaway recursion
+};
+
+struct debug_hit {
+	uint8_t  reason;
+	uint8_t  kind;      // DEBUG_READ, DEBUG_WRITE, DEBUG_EXEC or a stack fault
+	int      id;
+	uint16_t pc;        // istruction doing the access
+	uint16_t address;
+	uint8_t  value;     // byte read or written
+	uint64_t cycle;
+};
+
+extern uint8_t debug_page[256];
+// set from a signal handler too (debug_interrupt)
+extern volatile sig_atomic_t debug_stop;
+extern volatile sig_atomic_t debug_host;
+
+extern struct debug_hit debug_hit;
+
+// ranges are inclusive. return the point id, or a cpu_err
+extern int  debug_watch (uint16_t from, uint16_t to, uint8_t kind);
+extern int  debug_break (uint16_t pc);
+extern int  debug_cond  (int id, enum debug_reg reg, uint8_t value);
+extern int  debug_delete (int id);
+extern void debug_clear (void);
+
+// stop at the first istruction boundary at or after cycle, once
+extern void     debug_breakCycle (uint64_t cycle);
+extern uint64_t debug_cycle;
+
+// the istruction at pc runs even if a point is on it (step / continue from a stop)
+extern void debug_resume (void);
+
+// stop as soon as possible (i.e. from a signal handler). debug_hit says
+// DEBUG_HOST after debug_sync, which cpu_exec and cpu_run call on the way out
+extern void debug_interrupt (void);
+extern void debug_sync      (void);
+
+// stack checks, off by default. a push with SP at or below low (0: only the
+// wrap) or a pull that wraps stops like a watchpoint, debug_hit.pc is the
+// istruction and debug_hit.value the SP
+extern uint8_t debug_stackOn;
+extern uint8_t debug_stackLow;
+
+extern void debug_stackCheck (int on, uint8_t low);
+
+// off by default. cpu_FIXME (an opcode not implemented, BRK) stops like a
+// watchpoint instead of the dump, and the exit on an opcode not implemented
+extern uint8_t debug_fixmeOn;
+
+extern void debug_fixmeCheck (int on);
+
+// called by the cpu on flagged pages
+extern void debug_access (uint16_t address, uint8_t kind, uint8_t value);
+extern int  debug_exec   (void);
+extern void debug_stackFault (uint8_t kind);
+extern void debug_fixme      (void);
+
+#endif // DEBUG_H
@@ -0,0 +1,195 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <string.h>
+
+#include "cpu.h"
+#include "disasm.h"
+
+static const char hexdigit[] = "0123456789ABCDEF";
+
+// no printf, a line is a handful of stores
+static char *
+put_str (char *p, const char *s)
+{
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *
+put_hex8 (char *p, uint8_t v)
+{
+    *p++ = hexdigit[v >> 4];
+    *p++ = hexdigit[v & 0x0F];
+    return p;
+}
+
+static char *
+put_hex16 (char *p, uint16_t v)
+{
+    return put_hex8 (put_hex8 (p, v >> 8), v & 0xFF);
+}
+
+// " = nn"
+static char *
+put_value (char *p, uint16_t address)
+{
+    return put_hex8 (put_str (p, " = "), cpu_peek (address));
+}
+
+int
+disasm_len (uint16_t address)
+{
+    return ISA[mem[address]].ist_len;
+}
+
+int
+disasm_one (uint16_t address, int flags, char *buf, size_t len)
+{
+    if (len < DISASM_LINE) return 0;
+
+    const struct isa_t *isa = &ISA[mem[address]];
+    uint8_t  n  = isa->ist_len;
+    uint8_t  lo = mem[(uint16_t)(address + 1)];
+    uint8_t  hi = mem[(uint16_t)(address + 2)];
+    uint16_t op = lo | (hi << 8);
+    int resolve = flags & DISASM_RESOLVE;
+    uint16_t ea;
+    char *p = buf;
+
+    if (flags & DISASM_ADDR) {
+        p = put_str (put_hex16 (p, address), "  ");
+    }
+    if (flags & DISASM_BYTES) {
+        for (int i = 0; i < 3; i++) {
+            if (i < n) {
+                p = put_hex8 (p, mem[(uint16_t)(address + i)]);
+                *p++ = ' ';
+            } else {
+                p = put_str (p, "   ");
+            }
+        }
+        *p++ = ' ';
+    }
+
+    if (memcmp (isa->opcode, "---", 3)) {
+        memcpy (p, isa->opcode, 3);
+    } else {
+        memcpy (p, "???", 3);
+    }
+    p += 3;
+
+    switch (isa->mode) {
+    case CPU_AM_IMP:
+        break;
+
+    case CPU_AM_ACC:
+        p = put_str (p, " A");
+        break;
+
+    case CPU_AM_IMM:
+        p = put_hex8 (put_str (p, " #$"), lo);
+        break;
+
+    case CPU_AM_ZP:
+        p = put_hex8 (put_str (p, " $"), lo);
+        if (resolve) p = put_value (p, lo);
+        break;
+
+    case CPU_AM_ZPX:
+    case CPU_AM_ZPY:
+        p = put_hex8 (put_str (p, " $"), lo);
+        p = put_str (p, (isa->mode == CPU_AM_ZPX ? ",X" : ",Y"));
+        if (resolve) {
+            ea = (uint8_t)(lo + (isa->mode == CPU_AM_ZPX ? cpu.X : cpu.Y));
+            p = put_value (put_hex8 (put_str (p, " @ "), ea), ea);
+        }
+        break;
+
+    case CPU_AM_ABS:
+        p = put_hex16 (put_str (p, " $"), op);
+        // a jump target has no value
+        if (resolve && mem[address] != 0x4C && mem[address] != 0x20) p = put_value (p, op);
+        break;
+
+    case CPU_AM_ABSX:
+    case CPU_AM_ABSY:
+        p = put_hex16 (put_str (p, " $"), op);
+        p = put_str (p, (isa->mode == CPU_AM_ABSX ? ",X" : ",Y"));
+        if (resolve) {
+            ea = op + (isa->mode == CPU_AM_ABSX ? cpu.X : cpu.Y);
+            p = put_value (put_hex16 (put_str (p, " @ "), ea), ea);
+        }
+        break;
+
+    case CPU_AM_IND:
+        p = put_str (put_hex16 (put_str (p, " ($"), op), ")");
+        if (resolve) {
+            // the 6502 doesn't carry into the high byte of the pointer
+            ea = mem[op] | (mem[(op & 0xFF00) | ((op + 1) & 0x00FF)] << 8);
+            p = put_hex16 (put_str (p, " = "), ea);
+        }
+        break;
+
+    case CPU_AM_INDX:
+        p = put_str (put_hex8 (put_str (p, " ($"), lo), ",X)");
+        if (resolve) {
+            uint8_t zp = lo + cpu.X;
+            ea = mem[zp] | (mem[(uint8_t)(zp + 1)] << 8);
+            p = put_hex8 (put_str (p, " @ "), zp);
+            p = put_value (put_hex16 (put_str (p, " = "), ea), ea);
+        }
+        break;
+
+    case CPU_AM_INDY:
+        p = put_str (put_hex8 (put_str (p, " ($"), lo), "),Y");
+        if (resolve) {
+            uint16_t base = mem[lo] | (mem[(uint8_t)(lo + 1)] << 8);
+            ea = base + cpu.Y;
+            p = put_hex16 (put_str (p, " = "), base);
+            p = put_value (put_hex16 (put_str (p, " @ "), ea), ea);
+        }
+        break;
+
+    case CPU_AM_REL:
+        p = put_hex16 (put_str (p, " $"), address + 2 + (int8_t)lo);
+        break;
+    }
+
+    *p = '\0';
+    return n;
+}
+
+size_t
+disasm_range (uint16_t from, uint16_t to, int flags, char *buf, size_t len, uint32_t *next)
+{
+    uint32_t address = from;
+    char *p = buf;
+
+    if (len) *p = '\0';
+
+    // DISASM_LINE for the line, one more for its newline
+    while (address <= to && (size_t)(buf + len - p) > DISASM_LINE) {
+        int n = disasm_one (address, flags, p, DISASM_LINE);
+        p += strlen (p);
+        *p++ = '\n';
+        *p = '\0';
+        address += n;
+    }
+
+    if (next) *next = address;
+    return p - buf;
+}
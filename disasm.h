@@ -0,0 +1,51 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// disassembler on top of ISA[], nestest.log syntax
+// http://www.qmtpro.com/~nes/misc/nestest.log
+//
+//  C000  4C F5 C5  JMP $C5F5
+//  CFDB  A1 80     LDA ($80,X) @ 80 = 0200 = 5A
+//
+// text goes in the caller buffer, nothing is allocated. opcodes not
+// implemented yet show as ???, with the right operand length
+
+// longest line, terminator included
+#define DISASM_LINE 64
+
+enum disasm_flags {
+	DISASM_ADDR    = 1,     // address column
+	DISASM_BYTES   = 2,     // raw bytes column
+	DISASM_RESOLVE = 4      // effective address and value, with the registers as they are now
+};
+
+// length in bytes of the istruction at address
+extern int disasm_len (uint16_t address);
+
+// one istruction, returns its length. 0 if buf is shorter than DISASM_LINE
+extern int disasm_one (uint16_t address, int flags, char *buf, size_t len);
+
+// from..to (inclusive), one line each. stops early when buf is full: *next
+// (if not NULL) is where to go on. returns the text length
+extern size_t disasm_range (uint16_t from, uint16_t to, int flags, char *buf, size_t len, uint32_t *next);
+
+#endif // DISASM_H
@@ -0,0 +1,465 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "state.h"
+#include "stats.h"
+#include "fuzz.h"
+
+static struct fuzz_spec    spec;
+static uint16_t            ilen;        // input bytes, registers first
+static uint8_t             nregs;
+
+static uint8_t            *base;        // memory every run starts from
+static struct Tcpu         start;       // and registers
+
+static uint8_t            *map;         // this run
+static uint8_t            *seen;        // buckets ever hit, per byte
+
+static uint8_t            *corpus;      // ncorpus * ilen
+static uint32_t            ncorpus;
+static uint32_t            next;
+
+static struct fuzz_find   *finds;
+static struct fuzz_status  status;
+
+static uint64_t            rng;
+
+// opcodes that end a block: branches (taken or not), jumps, JSR, RTS, RTI
+static uint8_t             ctl[256];
+
+// hit counts to AFL buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static const uint8_t bucket[256] = {
+    [0] = 0, [1] = 1, [2] = 2, [3] = 4,
+    [4 ... 7] = 8, [8 ... 15] = 16, [16 ... 31] = 32, [32 ... 127] = 64, [128 ... 255] = 128
+};
+
+static uint64_t
+fuzz_nsec (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// xorshift64*
+static uint64_t
+fuzz_rand (void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545F4914F6CDD1Dull;
+}
+
+// a bitmap index for a PC, AFL gives every block a random one
+static inline uint16_t
+fuzz_hash (uint16_t pc)
+{
+    return (pc * 0x9E3779B1u) >> (32 - 14);
+}
+
+_Static_assert (FUZZ_MAPSIZE == 1 << 14, "fuzz_hash makes 14 bit indexes");
+
+// the writes allowed: every gap between them is a write watchpoint
+static int
+fuzz_watch (void)
+{
+    struct fuzz_range r[FUZZ_MAXALLOW + 1];
+    int n = spec.nallow;
+
+    if (!n) return CPU_OK;
+
+    memcpy (r, spec.allow, n * sizeof (*r));
+    r[n++] = (struct fuzz_range){ CPU_STACK, CPU_STACK + 0xFF };
+
+    // insertion sort by start, a handful of ranges
+    for (int i = 1; i < n; i++) {
+        struct fuzz_range t = r[i];
+        int j = i;
+
+        while (j > 0 && r[j - 1].from > t.from) {
+            r[j] = r[j - 1];
+            j--;
+        }
+        r[j] = t;
+    }
+
+    uint32_t from = 0;
+    for (int i = 0; i < n; i++) {
+        if (r[i].from > from) {
+            int err = debug_watch (from, r[i].from - 1, DEBUG_WRITE);
+            if (err < 0) return err;
+        }
+        if (r[i].to + 1u > from) from = r[i].to + 1u;
+    }
+    if (from < CPU_MEMSIZE) {
+        int err = debug_watch (from, CPU_MEMSIZE - 1, DEBUG_WRITE);
+        if (err < 0) return err;
+    }
+    return CPU_OK;
+}
+
+// the input from the machine / into it
+static void
+fuzz_get (uint8_t *input)
+{
+    uint8_t *in = input;
+
+    if (spec.regs & FUZZ_A) *in++ = start.A;
+    if (spec.regs & FUZZ_X) *in++ = start.X;
+    if (spec.regs & FUZZ_Y) *in++ = start.Y;
+    if (spec.regs & FUZZ_P) *in++ = start.P.P;
+
+    memcpy (in, &base[spec.address], spec.len);
+}
+
+static void
+fuzz_put (const uint8_t *input)
+{
+    const uint8_t *in = input;
+
+    if (spec.regs & FUZZ_A) cpu.A   = *in++;
+    if (spec.regs & FUZZ_X) cpu.X   = *in++;
+    if (spec.regs & FUZZ_Y) cpu.Y   = *in++;
+    if (spec.regs & FUZZ_P) cpu.P.P = *in++ | 0x20;
+
+    if (spec.len) {
+        memcpy (&mem[spec.address], in, spec.len);
+        for (int p = spec.address >> 8; p <= (spec.address + spec.len - 1) >> 8; p++) {
+            mem_dirty[p] = 1;
+        }
+    }
+}
+
+// back to the start, only the pages written
+static void
+fuzz_restore (void)
+{
+    for (int p = 0; p < CPU_MEMSIZE >> 8; p++) {
+        if (mem_dirty[p]) {
+            memcpy (&mem[p << 8], &base[p << 8], 256);
+            mem_dirty[p] = 0;
+        }
+    }
+    cpu = start;
+}
+
+// bucket the run's hits, 1 if one is new
+static int
+fuzz_novel (void)
+{
+    int novel = 0;
+
+    for (uint32_t i = 0; i < FUZZ_MAPSIZE; i += 8) {
+        uint64_t w;
+
+        memcpy (&w, &map[i], 8);
+        if (!w) continue;
+
+        for (uint32_t k = i; k < i + 8; k++) {
+            uint8_t b = bucket[map[k]];
+
+            if (b & ~seen[k]) {
+                status.edges += (seen[k] == 0);
+                seen[k] |= b;
+                novel = 1;
+            }
+        }
+    }
+    return novel;
+}
+
+static int
+fuzz_keep (const uint8_t *input)
+{
+    if (ncorpus == FUZZ_MAXCORPUS) return CPU_EFULL;
+
+    memcpy (&corpus[ncorpus * ilen], input, ilen);
+    status.corpus = ++ncorpus;
+    return CPU_OK;
+}
+
+// one finding per result and pc, the first input that got there is kept
+static void
+fuzz_found (enum fuzz_result r, const uint8_t *input)
+{
+    status.found++;
+
+    for (uint32_t i = 0; i < status.nfind; i++) {
+        if (finds[i].result == r && finds[i].pc == debug_hit.pc) {
+            finds[i].hits++;
+            return;
+        }
+    }
+    if (status.nfind == FUZZ_MAXFIND) return;
+
+    struct fuzz_find *f = &finds[status.nfind++];
+    f->result  = r;
+    f->pc      = debug_hit.pc;
+    f->address = debug_hit.address;
+    f->value   = debug_hit.value;
+    f->hits    = 1;
+    memcpy (f->input, input, ilen);
+}
+
+enum fuzz_result
+fuzz_exec (const uint8_t *input)
+{
+    enum fuzz_result r;
+    uint16_t prev = 0;
+    uint64_t end, nist = 0;
+
+    fuzz_restore ();
+    fuzz_put (input);
+    memset (map, 0, FUZZ_MAPSIZE);
+
+    end = cpu.cycle + spec.cycles;
+    debug_stop = 0;
+    debug_hit.reason = DEBUG_RUN;
+
+    for (;;) {
+        if (debug_stop || cpu.cycle >= end) {
+            r = FUZZ_BUDGET;
+            break;
+        }
+        if (cpu.PC == spec.ret) {
+            r = FUZZ_RET;
+            break;
+        }
+
+        nist += cpu_istr ();
+
+        // a new block
+        if (ctl[cpu.IR]) {
+            uint16_t cur = fuzz_hash (cpu.PC);
+
+            map[cur ^ prev]++;
+            prev = cur >> 1;
+        }
+    }
+
+    if (debug_stop) {
+        switch (debug_hit.reason) {
+        case DEBUG_FIXME: r = FUZZ_FIXME; break;
+        case DEBUG_STACK: r = FUZZ_STACK; break;
+        case DEBUG_HIT:   r = FUZZ_WRITE; break;
+        default:          break;
+        }
+    }
+
+    struct stats *s = stats_thread ();
+    stats_add (&s->istr, nist);
+    stats_add (&s->cycles, cpu.cycle - start.cycle);
+
+    status.execs++;
+    status.istr += nist;
+    status.ret    += (r == FUZZ_RET);
+    status.budget += (r == FUZZ_BUDGET);
+
+    if (r >= FUZZ_FIXME) fuzz_found (r, input);
+    if (fuzz_novel ()) fuzz_keep (input);
+
+    return r;
+}
+
+int
+fuzz_seed (const uint8_t *input)
+{
+    uint32_t n = ncorpus;
+
+    fuzz_exec (input);
+    return (ncorpus == n ? fuzz_keep (input) : CPU_OK);
+}
+
+static void
+fuzz_mutate (uint8_t *input)
+{
+    static const uint8_t interesting[] = { 0x00, 0x01, 0x02, 0x10, 0x20, 0x40, 0x7F, 0x80, 0x81, 0xFE, 0xFF };
+
+    // 1 to 16 stacked changes
+    int n = 1 << (fuzz_rand () % 5);
+
+    while (n--) {
+        uint64_t x  = fuzz_rand ();
+        uint16_t at = (x >> 8) % ilen;
+
+        switch (x % 6) {
+        case 0: input[at] ^= 1 << ((x >> 32) & 7);                                        break;
+        case 1: input[at]  = interesting[(x >> 32) % sizeof (interesting)];               break;
+        case 2: input[at] += 1 + (x >> 32) % 35;                                          break;
+        case 3: input[at] -= 1 + (x >> 32) % 35;                                          break;
+        case 4: input[at]  = x >> 32;                                                     break;
+        case 5: {
+            // splice: a piece of another corpus entry, same place
+            const uint8_t *other = &corpus[((x >> 32) % ncorpus) * ilen];
+            uint16_t len = 1 + (x >> 48) % (ilen - at);
+
+            memcpy (&input[at], &other[at], len);
+            break;
+        }
+        }
+    }
+}
+
+void
+fuzz_run (uint64_t execs)
+{
+    uint8_t  input[FUZZ_MAXINPUT];
+    uint64_t t0 = fuzz_nsec ();
+
+    if (!ncorpus) return;
+
+    while (execs--) {
+        memcpy (input, &corpus[(next++ % ncorpus) * ilen], ilen);
+        fuzz_mutate (input);
+        fuzz_exec (input);
+
+        // debug_interrupt, i.e. ^C
+        debug_sync ();
+        if (debug_stop && debug_hit.reason == DEBUG_HOST) break;
+    }
+
+    uint64_t ns = fuzz_nsec () - t0;
+    status.run_ns += ns;
+    stats_add (&stats_thread ()->run_ns, ns);
+}
+
+int
+fuzz_init (const struct fuzz_spec *s, const uint8_t *snap, size_t len)
+{
+    uint8_t input[FUZZ_MAXINPUT];
+    int     err;
+
+    fuzz_free ();
+
+    nregs = __builtin_popcount (s->regs & (FUZZ_A | FUZZ_X | FUZZ_Y | FUZZ_P));
+    if (!s->cycles || !(nregs + s->len) || nregs + s->len > FUZZ_MAXINPUT) return CPU_ESIZE;
+    if (s->address + s->len > CPU_MEMSIZE || s->nallow > FUZZ_MAXALLOW) return CPU_ESIZE;
+
+    if (snap && state_load (snap, len) != STATE_OK) return CPU_ESTATE;
+
+    for (int p = s->address >> 8; s->len && p <= (s->address + s->len - 1) >> 8; p++) {
+        if (mem_rom[p]) return CPU_EROM;
+    }
+
+    base   = malloc (CPU_MEMSIZE);
+    map    = aligned_alloc (64, FUZZ_MAPSIZE);
+    seen   = calloc (1, FUZZ_MAPSIZE);
+    corpus = malloc ((size_t)FUZZ_MAXCORPUS * (nregs + s->len));
+    finds  = calloc (FUZZ_MAXFIND, sizeof (*finds));
+    if (!base || !map || !seen || !corpus || !finds) {
+        fuzz_free ();
+        return CPU_ENOMEM;
+    }
+
+    for (int op = 0; op < 256; op++) {
+        ctl[op] = (ISA[op].mode == CPU_AM_REL || cpu_opTiming[op].step == 0 || op == 0x60);
+    }
+
+    spec = *s;
+    ilen = nregs + s->len;
+    rng  = (s->seed ? s->seed : 0x9E3779B97F4A7C15ull);
+
+    // as a JSR from ret - 3: the routine's RTS lands on ret
+    debug_clear ();
+    cpu.tcycle = 0;
+    cpu.intr   = 0;
+    cpu_push16 (spec.ret - 1);
+    cpu.PC = spec.entry;
+
+    memcpy (base, mem, CPU_MEMSIZE);
+    memset (mem_dirty, 0, sizeof (mem_dirty));
+    start = cpu;
+
+    debug_stackCheck (1, 0);
+    debug_fixmeCheck (1);
+    if ((err = fuzz_watch ()) != CPU_OK) {
+        fuzz_free ();
+        return err;
+    }
+
+    // what is there already is the first seed
+    fuzz_get (input);
+    return fuzz_seed (input);
+}
+
+void
+fuzz_free (void)
+{
+    if (base) debug_clear ();
+
+    free (base);
+    free (map);
+    free (seen);
+    free (corpus);
+    free (finds);
+
+    base   = NULL;
+    map    = NULL;
+    seen   = NULL;
+    corpus = NULL;
+    finds  = NULL;
+
+    ncorpus = 0;
+    next    = 0;
+    memset (&status, 0, sizeof (status));
+}
+
+void
+fuzz_status (struct fuzz_status *out)
+{
+    *out = status;
+}
+
+const struct fuzz_find *
+fuzz_find (uint32_t n)
+{
+    return (n < status.nfind ? &finds[n] : NULL);
+}
+
+void
+fuzz_report (FILE *out)
+{
+    static const char *const name[] = {
+        [FUZZ_RET] = "ret", [FUZZ_BUDGET] = "budget", [FUZZ_FIXME] = "fixme",
+        [FUZZ_STACK] = "stack", [FUZZ_WRITE] = "write"
+    };
+    double secs = status.run_ns / 1e9;
+
+    fprintf (out, "%lu execs in %.3fs (%.0f/s), %lu istr, %u edges, corpus %u\n",
+             (unsigned long)status.execs, secs, (secs ? status.execs / secs : 0.0),
+             (unsigned long)status.istr, status.edges, status.corpus);
+    fprintf (out, "%lu returned, %lu out of cycles, %lu findings at %u places\n",
+             (unsigned long)status.ret, (unsigned long)status.budget, (unsigned long)status.found, status.nfind);
+
+    for (uint32_t i = 0; i < status.nfind; i++) {
+        const struct fuzz_find *f = &finds[i];
+
+        fprintf (out, "%-5s pc $%04X address $%04X value $%02X hits %lu input",
+                 name[f->result], f->pc, f->address, f->value, (unsigned long)f->hits);
+        for (uint16_t k = 0; k < ilen; k++) {
+            fprintf (out, " %02X", f->input[k]);
+        }
+        fprintf (out, "\n");
+    }
+}
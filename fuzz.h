@@ -0,0 +1,122 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// coverage guided fuzzing of a routine
+//
+// from a snapshot the routine is called as by a JSR that returns to
+// spec.ret, with the input in the registers and / or a memory range. a run
+// ends on the return, on the cycle budget or on a finding:
+//   - an opcode not implemented or a BRK (cpu_FIXME, see debug_fixmeCheck)
+//   - the stack wrapping (debug_stackCheck)
+//   - a write outside the allowed ranges (write watchpoints on the rest)
+// coverage is AFL style: a branch (taken or not), jump, JSR, RTS or RTI
+// starts a block, each (previous, new) block pair bumps a byte of a bitmap. an input that lights a
+// new bit or bucket (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+ hits) goes to
+// the corpus, the next inputs are mutations of the corpus.
+// between runs only the pages written (mem_dirty) are copied back.
+// the fuzzer owns the machine: breakpoints and watchpoints are cleared, the
+// rewind ring can't be used meanwhile. a -DCPU_NODEBUG build finds no stack
+// wrap nor bad write.
+// https://lcamtuf.coredump.cx/afl/technical_details.txt
+
+#define FUZZ_MAPSIZE   (1 << 14)
+#define FUZZ_MAXINPUT  1024
+#define FUZZ_MAXCORPUS 4096
+#define FUZZ_MAXFIND   256
+#define FUZZ_MAXALLOW  16
+
+// registers taken from the input, first bytes, in this order
+#define FUZZ_A 1
+#define FUZZ_X 2
+#define FUZZ_Y 4
+#define FUZZ_P 8
+
+enum fuzz_result {
+	FUZZ_RET,           // the routine returned
+	FUZZ_BUDGET,        // out of cycles (a hang or a slow input)
+	FUZZ_FIXME,         // not implemented opcode or BRK
+	FUZZ_STACK,         // stack wrap
+	FUZZ_WRITE          // write outside the allowed ranges
+};
+
+// inclusive
+struct fuzz_range {
+	uint16_t from;
+	uint16_t to;
+};
+
+struct fuzz_spec {
+	uint16_t entry;     // the routine
+	uint16_t ret;       // its RTS lands here, nothing may run there
+	uint64_t cycles;    // budget per run
+	uint64_t seed;      // mutations
+
+	uint8_t  regs;      // FUZZ_A | FUZZ_X ...
+	uint16_t address;   // and the rest of the input here
+	uint16_t len;
+
+	// writes anywhere else are findings. the stack page is always allowed.
+	// none: no write check
+	uint8_t           nallow;
+	struct fuzz_range allow[FUZZ_MAXALLOW];
+};
+
+struct fuzz_find {
+	uint8_t  result;    // enum fuzz_result
+	uint16_t pc;        // istruction
+	uint16_t address;   // written or stack address, the pc for a fixme
+	uint8_t  value;     // opcode, SP or byte written
+	uint64_t hits;
+	uint8_t  input[FUZZ_MAXINPUT];
+};
+
+struct fuzz_status {
+	uint64_t execs;
+	uint64_t istr;
+	uint64_t ret;       // runs by result
+	uint64_t budget;
+	uint64_t found;
+	uint32_t corpus;
+	uint32_t edges;     // bitmap bytes ever hit
+	uint32_t nfind;     // findings, one per result and pc
+	uint64_t run_ns;
+};
+
+// snap (state_save) or, with NULL, the machine as it is. the first corpus
+// entry is the input already there. return a cpu_err
+extern int  fuzz_init (const struct fuzz_spec *spec, const uint8_t *snap, size_t len);
+extern void fuzz_free (void);
+
+// one run of input (spec length). the machine is left as the run ended
+extern enum fuzz_result fuzz_exec (const uint8_t *input);
+
+// add an input to the corpus (a seed), whatever its coverage
+extern int  fuzz_seed (const uint8_t *input);
+
+// 'execs' mutated runs
+extern void fuzz_run  (uint64_t execs);
+
+extern void fuzz_status (struct fuzz_status *out);
+extern const struct fuzz_find *fuzz_find (uint32_t n);
+extern void fuzz_report (FILE *out);
+
+#endif // FUZZ_H
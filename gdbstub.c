@@ -0,0 +1,545 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "cpu.h"
+#include "debug.h"
+#include "gdbstub.h"
+#include "net.h"
+
+#define PACKET 4096
+#define NREG   6
+
+// Z/z type to debug.c kind
+static const uint8_t zkind[5] = { DEBUG_EXEC, DEBUG_EXEC, DEBUG_WRITE, DEBUG_READ, DEBUG_READ | DEBUG_WRITE };
+
+struct gdb_point {
+    uint8_t  type;
+    uint16_t address;
+    uint16_t len;
+    int      id;
+};
+
+static int lfd = -1;            // listening socket
+static int cfd = -1;            // client
+static int halted;
+static int noack;
+static char unix_path[sizeof (((struct sockaddr_un *)0)->sun_path)];
+
+static uint8_t  inbuf[PACKET];
+static unsigned inpos, inlen;
+
+static struct gdb_point points[DEBUG_MAXPOINT];
+static int npoints;
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<feature name=\"org.c6510.cpu\">"
+    "<reg name=\"a\" bitsize=\"8\" type=\"uint8\" regnum=\"0\"/>"
+    "<reg name=\"x\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"y\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"p\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "</feature>"
+    "</target>";
+
+static const char hexdigit[] = "0123456789abcdef";
+
+static int
+gdb_unhex (char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// two hex digits, -1 if they aren't
+static int
+gdb_byte (const char *s)
+{
+    int h = gdb_unhex (s[0]);
+    int l = (h < 0 ? -1 : gdb_unhex (s[1]));
+    return (l < 0 ? -1 : (h << 4) | l);
+}
+
+static char *
+gdb_hex (char *out, uint8_t b)
+{
+    *out++ = hexdigit[b >> 4];
+    *out++ = hexdigit[b & 0x0F];
+    return out;
+}
+
+static void
+gdb_drop (void)
+{
+    for (int i = 0; i < npoints; i++) {
+        debug_delete (points[i].id);
+    }
+    npoints = 0;
+
+    if (cfd >= 0) close (cfd);
+    cfd    = -1;
+    halted = 0;
+}
+
+int
+gdb_listen (const char *where)
+{
+    gdb_close ();
+
+    int fd = net_listen (where, 1, NET_TCP | NET_NONBLOCK, unix_path, sizeof (unix_path));
+    if (fd < 0) return fd;
+
+    lfd = fd;
+    return CPU_OK;
+}
+
+void
+gdb_close (void)
+{
+    gdb_drop ();
+
+    net_close (lfd, unix_path);
+    lfd = -1;
+}
+
+// next byte from the client, -1 when it's gone. blocking
+static int
+gdb_getc (void)
+{
+    if (inpos == inlen) {
+        ssize_t n;
+        do {
+            n = recv (cfd, inbuf, sizeof (inbuf), 0);
+        } while (n < 0 && errno == EINTR);
+
+        if (n <= 0) return -1;
+        inpos = 0;
+        inlen = n;
+    }
+    return inbuf[inpos++];
+}
+
+// peek without blocking: a byte, -1 when it's gone, -2 if nothing came
+static int
+gdb_peek (void)
+{
+    if (inpos == inlen) {
+        ssize_t n = recv (cfd, inbuf, sizeof (inbuf), MSG_DONTWAIT);
+
+        if (n == 0) return -1;
+        if (n < 0) return ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? -2 : -1);
+        inpos = 0;
+        inlen = n;
+    }
+    return inbuf[inpos];
+}
+
+static int
+gdb_put (const char *data, size_t len)
+{
+    char pkt[PACKET + 4];
+    uint8_t sum = 0;
+
+    if (len > PACKET) len = PACKET;
+
+    pkt[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        pkt[i + 1] = data[i];
+        sum += (uint8_t)data[i];
+    }
+    pkt[len + 1] = '#';
+    gdb_hex (&pkt[len + 2], sum);
+
+    for (;;) {
+        if (send (cfd, pkt, len + 4, MSG_NOSIGNAL) != (ssize_t)(len + 4)) return -1;
+        if (noack) return 0;
+
+        int c;
+        do {
+            c = gdb_getc ();
+        } while (c >= 0 && c != '+' && c != '-');
+
+        if (c < 0)   return -1;
+        if (c == '+') return 0;
+    }
+}
+
+static int
+gdb_send (const char *data)
+{
+    return gdb_put (data, strlen (data));
+}
+
+// one packet, NUL terminated. returns the length, -1 when the client is gone,
+// -2 for a ^C
+static int
+gdb_recv (char *buf)
+{
+    for (;;) {
+        int c = gdb_getc ();
+
+        if (c < 0)    return -1;
+        if (c == 3)   return -2;
+        if (c != '$') continue;
+
+        uint8_t sum = 0;
+        int len = 0;
+
+        while ((c = gdb_getc ()) >= 0 && c != '#') {
+            if (len < PACKET - 1) buf[len++] = c;
+            sum += c;
+        }
+        if (c < 0) return -1;
+
+        int h = gdb_getc ();
+        int l = gdb_getc ();
+        if (h < 0 || l < 0) return -1;
+        buf[len] = '\0';
+
+        char cs[2] = { (char)h, (char)l };
+        if (noack) return len;
+        if (gdb_byte (cs) == sum) {
+            if (send (cfd, "+", 1, MSG_NOSIGNAL) != 1) return -1;
+            return len;
+        }
+        if (send (cfd, "-", 1, MSG_NOSIGNAL) != 1) return -1;
+    }
+}
+
+static int
+gdb_stopReply (void)
+{
+    char reply[32];
+
+    debug_sync ();
+    if (debug_stop && debug_hit.reason == DEBUG_HOST) {
+        strcpy (reply, "S02");
+    } else if (debug_stop && debug_hit.reason == DEBUG_STACK) {
+        strcpy (reply, "S0b");      // SIGSEGV
+    } else if (debug_stop && debug_hit.reason == DEBUG_FIXME) {
+        strcpy (reply, "S04");      // SIGILL
+    } else if (debug_stop && debug_hit.reason == DEBUG_HIT && debug_hit.kind != DEBUG_EXEC) {
+        const char *what = (debug_hit.kind == DEBUG_WRITE ? "watch" : "rwatch");
+        for (int i = 0; i < npoints; i++) {
+            if (points[i].id == debug_hit.id && points[i].type == 4) what = "awatch";
+        }
+        snprintf (reply, sizeof (reply), "T05%s:%04x;", what, debug_hit.address);
+    } else {
+        strcpy (reply, "S05");
+    }
+
+    debug_stop = 0;
+    return gdb_send (reply);
+}
+
+static uint8_t *
+gdb_reg (int n)
+{
+    switch (n) {
+        case 0:  return &cpu.A;
+        case 1:  return &cpu.X;
+        case 2:  return &cpu.Y;
+        case 3:  return &cpu.SP;
+        case 4:  return &cpu.P.P;
+        default: return NULL;
+    }
+}
+
+static void
+gdb_readRegs (char *out)
+{
+    for (int n = 0; n < NREG - 1; n++) {
+        out = gdb_hex (out, *gdb_reg (n));
+    }
+    out = gdb_hex (out, cpu.PCL);
+    out = gdb_hex (out, cpu.PCH);
+    *out = '\0';
+}
+
+static int
+gdb_writeRegs (const char *in)
+{
+    uint8_t v[NREG + 1];
+
+    for (int i = 0; i < NREG + 1; i++) {
+        int b = gdb_byte (&in[i * 2]);
+        if (b < 0) return -1;
+        v[i] = b;
+    }
+    for (int n = 0; n < NREG - 1; n++) {
+        *gdb_reg (n) = v[n];
+    }
+    cpu.PCL = v[NREG - 1];
+    cpu.PCH = v[NREG];
+    return 0;
+}
+
+static void
+gdb_readMem (char *out, unsigned address, unsigned len)
+{
+    if (address > 0xFFFF) len = 0;
+    if (len > CPU_MEMSIZE - address) len = CPU_MEMSIZE - address;
+    if (len > PACKET / 2 - 1) len = PACKET / 2 - 1;
+
+    for (unsigned i = 0; i < len; i++) {
+        out = gdb_hex (out, mem[address + i]);
+    }
+    *out = '\0';
+}
+
+// debugger stores bypass cpu_write: no watchpoints. roms are refused
+static int
+gdb_writeMem (unsigned address, unsigned len, const char *in)
+{
+    if (address > 0xFFFF || len > CPU_MEMSIZE - address) return -1;
+
+    for (unsigned i = 0; i < len; i++) {
+        if (mem_rom[(address + i) >> 8] || gdb_byte (&in[i * 2]) < 0) return -1;
+    }
+    for (unsigned i = 0; i < len; i++) {
+        mem[address + i] = gdb_byte (&in[i * 2]);
+        mem_dirty[(address + i) >> 8] = 1;
+    }
+    return 0;
+}
+
+static const char *
+gdb_point (int set, unsigned type, unsigned address, unsigned len)
+{
+    if (type > 4 || address > 0xFFFF) return "";
+    if (type < 2 || len == 0) len = 1;
+    if (len > CPU_MEMSIZE - address) len = CPU_MEMSIZE - address;
+
+    if (set) {
+        if (npoints == DEBUG_MAXPOINT) return "E12";
+
+        int id = debug_watch (address, address + len - 1, zkind[type]);
+        if (id < 0) return "E12";
+
+        points[npoints].type    = type;
+        points[npoints].address = address;
+        points[npoints].len     = len;
+        points[npoints].id      = id;
+        npoints++;
+        return "OK";
+    }
+
+    for (int i = 0; i < npoints; i++) {
+        if (points[i].type == type && points[i].address == address && points[i].len == len) {
+            debug_delete (points[i].id);
+            points[i] = points[--npoints];
+            return "OK";
+        }
+    }
+    return "E02";
+}
+
+static int
+gdb_xfer (const char *annex)
+{
+    static const char prefix[] = "qXfer:features:read:target.xml:";
+    unsigned off, len;
+    char out[PACKET];
+
+    if (strncmp (annex, prefix, sizeof (prefix) - 1) ||
+        sscanf (annex + sizeof (prefix) - 1, "%x,%x", &off, &len) != 2) {
+        return gdb_send ("");
+    }
+
+    if (off >= sizeof (target_xml) - 1) return gdb_send ("l");
+
+    unsigned left = sizeof (target_xml) - 1 - off;
+    if (len > PACKET - 2) len = PACKET - 2;
+    if (len > left) len = left;
+
+    out[0] = (len < left ? 'm' : 'l');
+    memcpy (&out[1], &target_xml[off], len);
+    return gdb_put (out, len + 1);
+}
+
+// one command while halted. -1 when the client is gone
+static int
+gdb_command (char *pkt, enum gdb_state *state)
+{
+    char out[PACKET];
+    unsigned a, b, c;
+    char *p;
+
+    switch (pkt[0]) {
+    case '?':
+        return gdb_stopReply ();
+
+    case 'g':
+        gdb_readRegs (out);
+        return gdb_send (out);
+
+    case 'G':
+        return gdb_send (strlen (pkt + 1) >= NREG * 2 + 2 && !gdb_writeRegs (pkt + 1) ? "OK" : "E01");
+
+    case 'p':
+        a = strtoul (pkt + 1, NULL, 16);
+        if (a == NREG - 1) {
+            gdb_hex (gdb_hex (out, cpu.PCL), cpu.PCH)[0] = '\0';
+        } else if (a < NREG - 1) {
+            gdb_hex (out, *gdb_reg (a))[0] = '\0';
+        } else {
+            return gdb_send ("E00");
+        }
+        return gdb_send (out);
+
+    case 'P':
+        a = strtoul (pkt + 1, &p, 16);
+        if (*p != '=' || a >= NREG || gdb_byte (p + 1) < 0) return gdb_send ("E01");
+        if (a == NREG - 1) {
+            if (gdb_byte (p + 3) < 0) return gdb_send ("E01");
+            cpu.PCL = gdb_byte (p + 1);
+            cpu.PCH = gdb_byte (p + 3);
+        } else {
+            *gdb_reg (a) = gdb_byte (p + 1);
+        }
+        return gdb_send ("OK");
+
+    case 'm':
+        if (sscanf (pkt + 1, "%x,%x", &a, &b) != 2) return gdb_send ("E01");
+        gdb_readMem (out, a, b);
+        return gdb_send (out);
+
+    case 'M':
+        if (sscanf (pkt + 1, "%x,%x:", &a, &b) != 2 || !(p = strchr (pkt, ':')) || strlen (p + 1) < b * 2) {
+            return gdb_send ("E01");
+        }
+        return gdb_send (gdb_writeMem (a, b, p + 1) ? "E0E" : "OK");
+
+    case 's':
+        if (pkt[1]) cpu.PC = strtoul (pkt + 1, NULL, 16);
+        debug_stop = 0;
+        debug_resume ();
+        cpu_istr ();
+        return gdb_stopReply ();
+
+    case 'c':
+        if (pkt[1]) cpu.PC = strtoul (pkt + 1, NULL, 16);
+        debug_resume ();
+        halted = 0;
+        return 0;
+
+    case 'Z':
+    case 'z':
+        if (sscanf (pkt + 1, "%x,%x,%x", &a, &b, &c) != 3) return gdb_send ("E01");
+        return gdb_send (gdb_point (pkt[0] == 'Z', a, b, c));
+
+    case 'k':
+        gdb_drop ();
+        *state = GDB_KILL;
+        return 0;
+
+    case 'D':
+        gdb_send ("OK");
+        gdb_drop ();
+        return 0;
+
+    case 'H':
+        return gdb_send ("OK");
+
+    case 'q':
+        if (!strncmp (pkt, "qSupported", 10)) {
+            snprintf (out, sizeof (out), "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+", PACKET);
+            return gdb_send (out);
+        }
+        if (!strcmp (pkt, "qAttached"))     return gdb_send ("1");
+        if (!strcmp (pkt, "qC"))            return gdb_send ("QC1");
+        if (!strcmp (pkt, "qfThreadInfo"))  return gdb_send ("m1");
+        if (!strcmp (pkt, "qsThreadInfo"))  return gdb_send ("l");
+        if (!strncmp (pkt, "qXfer:", 6))    return gdb_xfer (pkt);
+        return gdb_send ("");
+
+    case 'Q':
+        if (!strcmp (pkt, "QStartNoAckMode")) {
+            int err = gdb_send ("OK");
+            noack = 1;
+            return err;
+        }
+        return gdb_send ("");
+
+    default:
+        return gdb_send ("");
+    }
+}
+
+enum gdb_state
+gdb_poll (void)
+{
+    enum gdb_state state = GDB_RUN;
+    char pkt[PACKET];
+
+    if (lfd < 0) return GDB_RUN;
+
+    if (cfd < 0) {
+        if ((cfd = accept (lfd, NULL, NULL)) < 0) return GDB_RUN;
+
+        int one = 1;
+        setsockopt (cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+        // a new client finds the machine stopped
+        inpos = inlen = 0;
+        noack  = 0;
+        halted = 1;
+        debug_stop = 0;
+    } else if (!halted) {
+        if (debug_stop) {
+            // cpu_exec hit something, the client is waiting on 'c'
+            halted = 1;
+            if (gdb_stopReply ()) gdb_drop ();
+        } else {
+            int c = gdb_peek ();
+            if (c == -1) {
+                gdb_drop ();
+            } else if (c == 3) {
+                inpos++;
+                debug_interrupt ();
+                halted = 1;
+                if (gdb_stopReply ()) gdb_drop ();
+            }
+        }
+    }
+
+    while (halted && cfd >= 0) {
+        int len = gdb_recv (pkt);
+
+        if (len == -1) {
+            gdb_drop ();
+        } else if (len >= 0 && gdb_command (pkt, &state)) {
+            gdb_drop ();
+        }
+    }
+
+    return state;
+}
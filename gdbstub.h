@@ -0,0 +1,42 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+// gdb remote serial protocol
+// https://sourceware.org/gdb/onlinedocs/gdb/Remote-Protocol.html
+//
+// one client at a time. the host calls gdb_poll between cpu_exec slices: with
+// nobody attached it's a non blocking accept, while the debugger holds the
+// machine it serves packets until continue or detach.
+//
+// registers, in 'g' order: A X Y SP P (8 bit), PC (16 bit little endian)
+// breakpoints and watchpoints go through debug.c
+
+enum gdb_state {
+	GDB_RUN,            // let the cpu go
+	GDB_KILL            // the client sent 'k'
+};
+
+// "1234" is a tcp port on 127.0.0.1, anything else a unix socket path.
+// returns a cpu_err
+extern int  gdb_listen (const char *where);
+extern void gdb_close  (void);
+
+extern enum gdb_state gdb_poll (void);
+
+#endif // GDBSTUB_H
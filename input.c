@@ -0,0 +1,195 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <string.h>
+
+#include "cpu.h"
+#include "input.h"
+
+#define QUEUE 256
+
+struct input_event {
+    uint64_t cycle;
+    uint16_t address;
+    uint8_t  value;
+};
+
+uint64_t input_next = UINT64_MAX;
+
+static enum input_mode mode = INPUT_LIVE;
+static FILE *input_log;
+static uint64_t last_cycle;
+
+// posted, not yet applied
+static struct input_event queue[QUEUE];
+static unsigned qhead, qcount;
+
+static int
+input_putEvent (const struct input_event *ev)
+{
+    uint64_t delta = ev->cycle - last_cycle;
+
+    do {
+        uint8_t b = delta & 0x7F;
+        delta >>= 7;
+        if (fputc (b | (delta ? 0x80:0), input_log) == EOF) return -1;
+    } while (delta);
+
+    fputc (ev->address & 0xFF, input_log);
+    fputc (ev->address >> 8, input_log);
+    if (fputc (ev->value, input_log) == EOF) return -1;
+
+    last_cycle = ev->cycle;
+    return 0;
+}
+
+static int
+input_getEvent (struct input_event *ev)
+{
+    uint64_t delta = 0;
+    int shift = 0, c;
+
+    do {
+        if ((c = fgetc (input_log)) == EOF || shift > 63) return -1;
+        delta |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    int lo = fgetc (input_log);
+    int hi = fgetc (input_log);
+    int v  = fgetc (input_log);
+    if (v == EOF) return -1;
+
+    ev->cycle   = last_cycle + delta;
+    ev->address = lo | (hi << 8);
+    ev->value   = v;
+
+    last_cycle = ev->cycle;
+    return 0;
+}
+
+static void
+input_push (uint64_t cycle, uint16_t address, uint8_t value)
+{
+    if (qcount == QUEUE) {
+        // host is posting faster than the cpu runs, the oldest lands now
+        cpu_write (queue[qhead].address, queue[qhead].value);
+        qhead = (qhead + 1) % QUEUE;
+        qcount--;
+    }
+
+    struct input_event *ev = &queue[(qhead + qcount++) % QUEUE];
+    ev->cycle   = cycle;
+    ev->address = address;
+    ev->value   = value;
+
+    if (ev == &queue[qhead]) input_next = cycle;
+}
+
+int
+input_record (FILE *log)
+{
+    input_stop ();
+
+    if (fwrite (INPUT_MAGIC, 8, 1, log) != 1) return -1;
+    fputc (INPUT_VERSION & 0xFF, log);
+    fputc (INPUT_VERSION >> 8, log);
+
+    input_log  = log;
+    last_cycle = 0;
+    mode       = INPUT_RECORD;
+    return 0;
+}
+
+int
+input_replay (FILE *log)
+{
+    char magic[8];
+
+    input_stop ();
+
+    if (fread (magic, 8, 1, log) != 1 || memcmp (magic, INPUT_MAGIC, 8)) return -1;
+
+    int lo = fgetc (log);
+    int hi = fgetc (log);
+    if (hi == EOF || (lo | (hi << 8)) != INPUT_VERSION) return -1;
+
+    input_log  = log;
+    last_cycle = 0;
+    mode       = INPUT_REPLAY;
+
+    struct input_event ev;
+    if (input_getEvent (&ev) == 0) {
+        input_push (ev.cycle, ev.address, ev.value);
+    }
+    return 0;
+}
+
+// back to live inputs. what has been posted and logged still lands in memory,
+// what has been read ahead from a replay log is dropped
+void
+input_stop (void)
+{
+    if (mode == INPUT_RECORD) fflush (input_log);
+
+    if (mode == INPUT_REPLAY) {
+        qhead      = 0;
+        qcount     = 0;
+        input_next = UINT64_MAX;
+    }
+
+    input_log = NULL;
+    mode      = INPUT_LIVE;
+}
+
+// ignored while replaying, the log is the only source of inputs then.
+// a log write that fails stops the recording (the input still lands): -1
+int
+input_post (uint16_t address, uint8_t value)
+{
+    if (mode == INPUT_REPLAY) return 0;
+
+    input_push (cpu.cycle, address, value);
+
+    if (mode == INPUT_RECORD && input_putEvent (&queue[(qhead + qcount - 1) % QUEUE])) {
+        input_stop ();
+        return -1;
+    }
+    return 0;
+}
+
+// istruction boundary, cpu.cycle >= input_next
+void
+input_poll (void)
+{
+    while (qcount && queue[qhead].cycle <= cpu.cycle) {
+        struct input_event *ev = &queue[qhead];
+
+        cpu_write (ev->address, ev->value);
+
+        qhead = (qhead + 1) % QUEUE;
+        qcount--;
+
+        if (mode == INPUT_REPLAY && qcount == 0) {
+            struct input_event next;
+            if (input_getEvent (&next) == 0) {
+                input_push (next.cycle, next.address, next.value);
+            }
+        }
+    }
+
+    input_next = (qcount ? queue[qhead].cycle : UINT64_MAX);
+}
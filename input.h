@@ -0,0 +1,50 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// external inputs (keyboard matrix $DC01, joystick $DC00/$DC01, time of day
+// $DC08-$DC0B, ...) are posted by the host and land in memory on the next
+// istruction boundary, so a recorded session replays bit exact.
+//
+// log: "C6510INP" u16 version, then one event per input:
+//      cycle delta from the previous event (LEB128), address u16, value u8
+
+#define INPUT_MAGIC   "C6510INP"
+#define INPUT_VERSION 1
+
+enum input_mode {
+	INPUT_LIVE,
+	INPUT_RECORD,
+	INPUT_REPLAY
+};
+
+// next cycle input_poll has something to do at, checked by the cpu loop
+extern uint64_t input_next;
+
+extern int  input_record (FILE *log);
+extern int  input_replay (FILE *log);
+extern void input_stop   (void);
+
+// -1: the recording failed and is stopped
+extern int  input_post   (uint16_t address, uint8_t value);
+extern void input_poll   (void);
+
+#endif // INPUT_H
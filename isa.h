@@ -0,0 +1,181 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// opcode spec, one line per implemented opcode. no include guard: cpu.c
+// includes it once per use with ISA_OP defined (checks, metadata, handlers).
+// the length follows from the mode, the mode has to match the opcode bits.
+// step is what the PC moves after the handler: the length, or 0 when the
+// handler sets PC itself. kind is the bus cycles the handler is built from,
+// operation is what it does with the byte:
+//   RD   load, void f (uint8_t)          WR   store, uint8_t f (void)
+//   RMW  read-modify-write, uint8_t f (uint8_t)
+//   REG  implied / accumulator, void f (void)
+//   PSH  PHA PHP, uint8_t f (void)       PUL  PLA PLP, void f (uint8_t)
+//   OWN  the handler is the operation, cycles and all
+// clock has to agree with the kind. opcodes not listed run cpu_FIXME
+//
+//      opcode name   mode   clock step kind operation
+ISA_OP (0x00, "BRK", IMP,  7, 2, OWN, cpu_BRK)          // Force Break. FIXME: fire an irq, the PC+2 skips the padding byte
+ISA_OP (0x01, "ORA", INDX, 6, 2, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x05, "ORA", ZP,   3, 2, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x06, "ASL", ZP,   5, 2, RMW, cpu_ASL)          // Shift Left One Bit (Memory or Accumulator)
+ISA_OP (0x08, "PHP", IMP,  3, 1, PSH, cpu_PHP)          // Push Processor Status on Stack
+ISA_OP (0x09, "ORA", IMM,  2, 2, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x0A, "ASL", ACC,  2, 1, REG, cpu_ASL_A)        // Shift Left One Bit Accumulator
+ISA_OP (0x0D, "ORA", ABS,  4, 3, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x0E, "ASL", ABS,  6, 3, RMW, cpu_ASL)          // Shift Left One Bit (Memory or Accumulator)
+ISA_OP (0x10, "BPL", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Result Plus
+ISA_OP (0x11, "ORA", INDY, 5, 2, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x15, "ORA", ZPX,  4, 2, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x16, "ASL", ZPX,  6, 2, RMW, cpu_ASL)          // Shift Left One Bit (Memory or Accumulator)
+ISA_OP (0x18, "CLC", IMP,  2, 1, REG, cpu_CLC)          // Clear Carry Flag
+ISA_OP (0x19, "ORA", ABSY, 4, 3, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x1D, "ORA", ABSX, 4, 3, RD,  cpu_ORA)          // OR Memory with Accumulator
+ISA_OP (0x1E, "ASL", ABSX, 7, 3, RMW, cpu_ASL)          // Shift Left One Bit (Memory or Accumulator)
+ISA_OP (0x20, "JSR", ABS,  6, 0, OWN, cpu_JSR)          // Jump to New Location Saving Return Address
+ISA_OP (0x21, "AND", INDX, 6, 2, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x24, "BIT", ZP,   3, 2, RD,  cpu_BIT)          // Test Bits in Memory with Accumulator
+ISA_OP (0x25, "AND", ZP,   3, 2, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x26, "ROL", ZP,   5, 2, RMW, cpu_ROL)          // Rotate One Bit Left (Memory or Accumulator)
+ISA_OP (0x28, "PLP", IMP,  4, 1, PUL, cpu_PLP)          // Pull Processor Status from Stack
+ISA_OP (0x29, "AND", IMM,  2, 2, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x2A, "ROL", ACC,  2, 1, REG, cpu_ROL_A)        // Rotate One Bit Left (Memory or Accumulator)
+ISA_OP (0x2C, "BIT", ABS,  4, 3, RD,  cpu_BIT)          // Test Bits in Memory with Accumulator
+ISA_OP (0x2D, "AND", ABS,  4, 3, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x2E, "ROL", ABS,  6, 3, RMW, cpu_ROL)          // Rotate One Bit Left (Memory or Accumulator)
+ISA_OP (0x30, "BMI", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Result Minus
+ISA_OP (0x31, "AND", INDY, 5, 2, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x35, "AND", ZPX,  4, 2, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x36, "ROL", ZPX,  6, 2, RMW, cpu_ROL)          // Rotate One Bit Left (Memory or Accumulator)
+ISA_OP (0x38, "SEC", IMP,  2, 1, REG, cpu_SEC)          // Set Carry Flag
+ISA_OP (0x39, "AND", ABSY, 4, 3, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x3D, "AND", ABSX, 4, 3, RD,  cpu_AND)          // AND Memory with Accumulator
+ISA_OP (0x3E, "ROL", ABSX, 7, 3, RMW, cpu_ROL)          // Rotate One Bit Left (Memory or Accumulator)
+ISA_OP (0x40, "RTI", IMP,  6, 0, OWN, cpu_RTI)          // Return from Interrupt
+ISA_OP (0x41, "EOR", INDX, 6, 2, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x45, "EOR", ZP,   3, 2, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x46, "LSR", ZP,   5, 2, RMW, cpu_LSR)          // Shift One Bit Right (Memory or Accumulator)
+ISA_OP (0x48, "PHA", IMP,  3, 1, PSH, cpu_STA)          // Push Accumulator on Stack
+ISA_OP (0x49, "EOR", IMM,  2, 2, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x4A, "LSR", ACC,  2, 1, REG, cpu_LSR_A)        // Shift One Bit Right Accumulator
+ISA_OP (0x4C, "JMP", ABS,  3, 0, OWN, cpu_JMP_ABS)      // Jump to New Location
+ISA_OP (0x4D, "EOR", ABS,  4, 3, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x4E, "LSR", ABS,  6, 3, RMW, cpu_LSR)          // Shift One Bit Right (Memory or Accumulator)
+ISA_OP (0x50, "BVC", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Overflow Clear
+ISA_OP (0x51, "EOR", INDY, 5, 2, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x55, "EOR", ZPX,  4, 2, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x56, "LSR", ZPX,  6, 2, RMW, cpu_LSR)          // Shift One Bit Right (Memory or Accumulator)
+ISA_OP (0x58, "CLI", IMP,  2, 1, REG, cpu_CLI)          // Clear Interrupt Disable Bit
+ISA_OP (0x59, "EOR", ABSY, 4, 3, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x5D, "EOR", ABSX, 4, 3, RD,  cpu_EOR)          // Exclusive-OR Memory with Accumulator
+ISA_OP (0x5E, "LSR", ABSX, 7, 3, RMW, cpu_LSR)          // Shift One Bit Right (Memory or Accumulator)
+ISA_OP (0x60, "RTS", IMP,  6, 1, OWN, cpu_RTS)          // Return from Subroutine
+ISA_OP (0x61, "ADC", INDX, 6, 2, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x65, "ADC", ZP,   3, 2, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x66, "ROR", ZP,   5, 2, RMW, cpu_ROR)          // Rotate One Bit Right (Memory or Accumulator)
+ISA_OP (0x68, "PLA", IMP,  4, 1, PUL, cpu_LDA)          // Pull Accumulator from Stack
+ISA_OP (0x69, "ADC", IMM,  2, 2, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x6A, "ROR", ACC,  2, 1, REG, cpu_ROR_A)        // Rotate One Bit Right Accumulator
+ISA_OP (0x6C, "JMP", IND,  5, 0, OWN, cpu_JMP_IND)      // Jump indirect
+ISA_OP (0x6D, "ADC", ABS,  4, 3, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x6E, "ROR", ABS,  6, 3, RMW, cpu_ROR)          // Rotate One Bit Right (Memory or Accumulator)
+ISA_OP (0x70, "BVS", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Overflow Set
+ISA_OP (0x71, "ADC", INDY, 5, 2, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x75, "ADC", ZPX,  4, 2, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x76, "ROR", ZPX,  6, 2, RMW, cpu_ROR)          // Rotate One Bit Right (Memory or Accumulator)
+ISA_OP (0x78, "SEI", IMP,  2, 1, REG, cpu_SEI)          // Set Interrupt Disable Status
+ISA_OP (0x79, "ADC", ABSY, 4, 3, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x7D, "ADC", ABSX, 4, 3, RD,  cpu_ADC)          // Add Memory to Accumulator with Carry
+ISA_OP (0x7E, "ROR", ABSX, 7, 3, RMW, cpu_ROR)          // Rotate One Bit Right (Memory or Accumulator)
+ISA_OP (0x81, "STA", INDX, 6, 2, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0x84, "STY", ZP,   3, 2, WR,  cpu_STY)          // Store Index Y in Memory
+ISA_OP (0x85, "STA", ZP,   3, 2, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0x86, "STX", ZP,   3, 2, WR,  cpu_STX)          // Store Index X in Memory
+ISA_OP (0x88, "DEY", IMP,  2, 1, REG, cpu_DEY)          // Decrement Index Y
+ISA_OP (0x8A, "TXA", IMP,  2, 1, REG, cpu_TXA)          // Transfer Index X to Accumulator
+ISA_OP (0x8C, "STY", ABS,  4, 3, WR,  cpu_STY)          // Store Index Y in Memory
+ISA_OP (0x8D, "STA", ABS,  4, 3, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0x8E, "STX", ABS,  4, 3, WR,  cpu_STX)          // Store Index X in Memory
+ISA_OP (0x90, "BCC", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Carry Clear
+ISA_OP (0x91, "STA", INDY, 6, 2, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0x94, "STY", ZPX,  4, 2, WR,  cpu_STY)          // Store Index Y in Memory
+ISA_OP (0x95, "STA", ZPX,  4, 2, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0x96, "STX", ZPY,  4, 2, WR,  cpu_STX)          // Store Index X in Memory
+ISA_OP (0x98, "TYA", IMP,  2, 1, REG, cpu_TYA)          // Transfer Index Y to Accumulator
+ISA_OP (0x99, "STA", ABSY, 5, 3, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0x9A, "TXS", IMP,  2, 1, REG, cpu_TXS)          // Transfer Index X to Stack Register
+ISA_OP (0x9D, "STA", ABSX, 5, 3, WR,  cpu_STA)          // Store Accumulator in Memory
+ISA_OP (0xA0, "LDY", IMM,  2, 2, RD,  cpu_LDY)          // Load Index Y with Memory
+ISA_OP (0xA1, "LDA", INDX, 6, 2, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xA2, "LDX", IMM,  2, 2, RD,  cpu_LDX)          // Load Index X with Memory
+ISA_OP (0xA4, "LDY", ZP,   3, 2, RD,  cpu_LDY)          // Load Index Y with Memory
+ISA_OP (0xA5, "LDA", ZP,   3, 2, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xA6, "LDX", ZP,   3, 2, RD,  cpu_LDX)          // Load Index X with Memory
+ISA_OP (0xA8, "TAY", IMP,  2, 1, REG, cpu_TAY)          // Transfer Accumulator to Index Y
+ISA_OP (0xA9, "LDA", IMM,  2, 2, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xAA, "TAX", IMP,  2, 1, REG, cpu_TAX)          // Transfer Accumulator to Index X
+ISA_OP (0xAC, "LDY", ABS,  4, 3, RD,  cpu_LDY)          // Load index Y with memory
+ISA_OP (0xAD, "LDA", ABS,  4, 3, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xAE, "LDX", ABS,  4, 3, RD,  cpu_LDX)          // Load Index X with Memory
+ISA_OP (0xB0, "BCS", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Carry Set
+ISA_OP (0xB1, "LDA", INDY, 5, 2, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xB4, "LDY", ZPX,  4, 2, RD,  cpu_LDY)          // Load Index Y with Memory
+ISA_OP (0xB5, "LDA", ZPX,  4, 2, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xB6, "LDX", ZPY,  4, 2, RD,  cpu_LDX)          // Load Index X with Memory
+ISA_OP (0xB8, "CLV", IMP,  2, 1, REG, cpu_CLV)          // Clear Overflow Flag
+ISA_OP (0xB9, "LDA", ABSY, 4, 3, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xBA, "TSX", IMP,  2, 1, REG, cpu_TSX)          // Transfer Stack Pointer to Index X
+ISA_OP (0xBC, "LDY", ABSX, 4, 3, RD,  cpu_LDY)          // Load Index Y with Memory
+ISA_OP (0xBD, "LDA", ABSX, 4, 3, RD,  cpu_LDA)          // Load Accumulator with Memory
+ISA_OP (0xBE, "LDX", ABSY, 4, 3, RD,  cpu_LDX)          // Load Index X with Memory
+ISA_OP (0xC0, "CPY", IMM,  2, 2, RD,  cpu_CPY)          // Compare Memory and Index Y
+ISA_OP (0xC1, "CMP", INDX, 6, 2, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xC4, "CPY", ZP,   3, 2, RD,  cpu_CPY)          // Compare Memory and Index Y
+ISA_OP (0xC5, "CMP", ZP,   3, 2, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xC6, "DEC", ZP,   5, 2, RMW, cpu_DEC)          // Decrement Memory by One
+ISA_OP (0xC8, "INY", IMP,  2, 1, REG, cpu_INY)          // Increment Index Y by One
+ISA_OP (0xC9, "CMP", IMM,  2, 2, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xCA, "DEX", IMP,  2, 1, REG, cpu_DEX)          // Decrement Index X by One
+ISA_OP (0xCC, "CPY", ABS,  4, 3, RD,  cpu_CPY)          // Compare Memory and Index Y
+ISA_OP (0xCD, "CMP", ABS,  4, 3, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xCE, "DEC", ABS,  6, 3, RMW, cpu_DEC)          // Decrement Memory by One
+ISA_OP (0xD0, "BNE", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Result not Zero
+ISA_OP (0xD1, "CMP", INDY, 5, 2, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xD5, "CMP", ZPX,  4, 2, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xD6, "DEC", ZPX,  6, 2, RMW, cpu_DEC)          // Decrement Memory by One
+ISA_OP (0xD8, "CLD", IMP,  2, 1, REG, cpu_CLD)          // Clear Decimal Mode
+ISA_OP (0xD9, "CMP", ABSY, 4, 3, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xDD, "CMP", ABSX, 4, 3, RD,  cpu_CMP)          // Compare Memory with Accumulator
+ISA_OP (0xDE, "DEC", ABSX, 7, 3, RMW, cpu_DEC)          // Decrement Memory by One
+ISA_OP (0xE0, "CPX", IMM,  2, 2, RD,  cpu_CPX)          // Compare Memory and Index X
+ISA_OP (0xE1, "SBC", INDX, 6, 2, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xE4, "CPX", ZP,   3, 2, RD,  cpu_CPX)          // Compare Memory and Index X
+ISA_OP (0xE5, "SBC", ZP,   3, 2, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xE6, "INC", ZP,   5, 2, RMW, cpu_INC)          // Increment Memory by One
+ISA_OP (0xE8, "INX", IMP,  2, 1, REG, cpu_INX)          // Increment Index X by One
+ISA_OP (0xE9, "SBC", IMM,  2, 2, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xEA, "NOP", IMP,  2, 1, REG, cpu_NOP)          // No Operation
+ISA_OP (0xEC, "CPX", ABS,  4, 3, RD,  cpu_CPX)          // Compare Memory and Index X
+ISA_OP (0xED, "SBC", ABS,  4, 3, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xEE, "INC", ABS,  6, 3, RMW, cpu_INC)          // Increment Memory by One
+ISA_OP (0xF0, "BEQ", REL,  2, 2, OWN, cpu_BRANCH)       // Branch on Result Zero
+ISA_OP (0xF1, "SBC", INDY, 5, 2, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xF5, "SBC", ZPX,  4, 2, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xF6, "INC", ZPX,  6, 2, RMW, cpu_INC)          // Increment Memory by One
+ISA_OP (0xF8, "SED", IMP,  2, 1, REG, cpu_SED)          // Set Decimal Flag
+ISA_OP (0xF9, "SBC", ABSY, 4, 3, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xFD, "SBC", ABSX, 4, 3, RD,  cpu_SBC)          // Subtract Memory from Accumulator with Borrow
+ISA_OP (0xFE, "INC", ABSX, 7, 3, RMW, cpu_INC)          // Increment Memory by One
@@ -0,0 +1,523 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+
+#include "cpu.h"
+#include "state.h"
+#include "petscii.h"
+#include "kernal.h"
+
+
+// fast boot
+
+// cache file: the magic, then per entry digest, snapshot length (u64 little
+// endian each) and the snapshot
+#define FASTBOOT_MAGIC "C6510FBC"
+
+// well known slow routines, the first bytes tell this is the expected kernal
+static const struct {
+    const char *name;
+    uint16_t    entry;
+    uint8_t     sig[8];
+} routines[] = {
+    { "RAMTAS", 0xFD50, { 0xA9, 0x00, 0xA8, 0x99, 0x02, 0x00, 0x99, 0x00 } },
+    { "CINT",   0xFF5B, { 0x20, 0x18, 0xE5, 0xAD, 0x12, 0xD0, 0xD0, 0xFB } }
+};
+
+#define NROUTINES (sizeof (routines) / sizeof (routines[0]))
+
+// the key is state_digest on entry, cycle included on purpose: the snapshot
+// restores the cycle of the return, which is only right for the cycle it was
+// taken from. a boot replayed from power on hits every time, anything else
+// runs the routine for real
+struct fastboot_entry {
+    uint64_t digest;   // state on entry
+    size_t   len;
+    uint8_t *snap;     // state on return
+};
+
+static struct fastboot_entry *cache;
+static int    ncache;
+static FILE  *cachefp;
+
+// routine being run for real, to be memoized on return
+static struct {
+    int      active;
+    uint64_t digest;
+    uint8_t  sp;
+    uint16_t ret;
+} pending;
+
+static void
+fastboot_put64 (FILE *fp, uint64_t v)
+{
+    uint8_t b[8];
+
+    for (int i = 0; i < 8; i++) {
+        b[i] = v >> (8 * i);
+    }
+    fwrite (b, 8, 1, fp);
+}
+
+static int
+fastboot_get64 (FILE *fp, uint64_t *v)
+{
+    uint8_t b[8];
+
+    if (fread (b, 8, 1, fp) != 1) return 0;
+
+    *v = 0;
+    for (int i = 0; i < 8; i++) {
+        *v |= (uint64_t)b[i] << (8 * i);
+    }
+    return 1;
+}
+
+static int
+fastboot_add (uint64_t digest, uint8_t *snap, size_t len)
+{
+    struct fastboot_entry *c = realloc (cache, (ncache + 1) * sizeof (*c));
+    if (!c) return CPU_EFULL;
+
+    cache = c;
+    cache[ncache].digest = digest;
+    cache[ncache].len    = len;
+    cache[ncache].snap   = snap;
+    ncache++;
+
+    return CPU_OK;
+}
+
+static int
+fastboot_return (void)
+{
+    // a nested JSR coming back here doesn't count
+    if (!pending.active || cpu.SP != (uint8_t)(pending.sp + 2)) return 0;
+
+    cpu_setTrap (pending.ret, NULL);
+    pending.active = 0;
+
+    size_t len = state_size ();
+    uint8_t *snap = malloc (len);
+    if (!snap) return 0;
+
+    if (state_save (snap, len) < 0 || fastboot_add (pending.digest, snap, len) != CPU_OK) {
+        free (snap);
+        return 0;
+    }
+
+    if (cachefp) {
+        fastboot_put64 (cachefp, pending.digest);
+        fastboot_put64 (cachefp, len);
+        fwrite (snap, len, 1, cachefp);
+        fflush (cachefp);
+    }
+    return 0;
+}
+
+static int
+fastboot_entry (void)
+{
+    if (pending.active) return 0;
+
+    uint64_t digest = state_digest ();
+
+    for (int i = 0; i < ncache; i++) {
+        if (cache[i].digest == digest && state_load (cache[i].snap, cache[i].len) == STATE_OK) {
+            return 1;
+        }
+    }
+
+    // first time here: run it, keep the result
+    pending.active = 1;
+    pending.digest = digest;
+    pending.sp     = cpu.SP;
+    pending.ret    = (mem[CPU_STACK + (uint8_t)(cpu.SP + 1)] | (mem[CPU_STACK + (uint8_t)(cpu.SP + 2)] << 8)) + 1;
+
+    if (cpu_setTrap (pending.ret, fastboot_return) != CPU_OK) {
+        pending.active = 0;
+    }
+    return 0;
+}
+
+static void
+fastboot_read (FILE *fp)
+{
+    uint64_t digest, len;
+
+    while (fastboot_get64 (fp, &digest) && fastboot_get64 (fp, &len)) {
+        uint8_t *snap = (len <= SIZE_MAX ? malloc (len) : NULL);
+
+        if (!snap || fread (snap, len, 1, fp) != 1 || fastboot_add (digest, snap, len) != CPU_OK) {
+            free (snap);
+            break;
+        }
+    }
+}
+
+// call after the roms are loaded
+int
+kernal_fastboot (const char *cachefile)
+{
+    kernal_fastbootOff ();
+
+    for (unsigned i = 0; i < NROUTINES; i++) {
+        if (memcmp (&mem[routines[i].entry], routines[i].sig, sizeof (routines[i].sig))) return CPU_EFORMAT;
+    }
+
+    if (cachefile) {
+        char magic[8];
+
+        cachefp = fopen (cachefile, "a+b");
+        if (!cachefp) return CPU_ENOENT;
+
+        rewind (cachefp);
+        if (fread (magic, 8, 1, cachefp) == 1) {
+            if (memcmp (magic, FASTBOOT_MAGIC, 8)) {
+                fclose (cachefp);
+                cachefp = NULL;
+                return CPU_EFORMAT;
+            }
+            fastboot_read (cachefp);
+        } else {
+            fwrite (FASTBOOT_MAGIC, 8, 1, cachefp);
+        }
+        fseek (cachefp, 0, SEEK_END);
+    }
+
+    for (unsigned i = 0; i < NROUTINES; i++) {
+        if (cpu_setTrap (routines[i].entry, fastboot_entry) != CPU_OK) return CPU_EFULL;
+    }
+    return CPU_OK;
+}
+
+void
+kernal_fastbootOff (void)
+{
+    for (unsigned i = 0; i < NROUTINES; i++) {
+        cpu_setTrap (routines[i].entry, NULL);
+    }
+    if (pending.active) {
+        cpu_setTrap (pending.ret, NULL);
+        pending.active = 0;
+    }
+
+    for (int i = 0; i < ncache; i++) {
+        free (cache[i].snap);
+    }
+    free (cache);
+    cache  = NULL;
+    ncache = 0;
+
+    if (cachefp) {
+        fclose (cachefp);
+        cachefp = NULL;
+    }
+}
+
+// READY and program injection
+
+#define READY_LOOP 0xE5CD
+#define READY_END  0xE5D4
+
+static const uint8_t ready_sig[] = { 0xA5, 0xC6, 0x85, 0xCC, 0x8D, 0x92, 0x02, 0xF0, 0xF7 };
+
+int
+kernal_isReady (void)
+{
+    return cpu.PC >= READY_LOOP && cpu.PC <= READY_END && cpu.tcycle == 0 &&
+           !memcmp (&mem[READY_LOOP], ready_sig, sizeof (ready_sig));
+}
+
+// CPU_OK once at READY, CPU_ESTATE if it's not there within 'cycles' or
+// there's no kernal to get there (the machine is left as it was)
+int
+kernal_runToReady (uint64_t cycles)
+{
+    uint64_t end = cpu.cycle + cycles;
+
+    if (memcmp (&mem[READY_LOOP], ready_sig, sizeof (ready_sig))) return CPU_ESTATE;
+
+    while (!kernal_isReady ()) {
+        if (cpu.cycle >= end) return CPU_ESTATE;
+        cpu_exec (1);
+    }
+    return CPU_OK;
+}
+
+static void
+kernal_poke16 (uint16_t address, uint16_t value)
+{
+    cpu_write (address, value & 0xFF);
+    cpu_write (address + 1, value >> 8);
+}
+
+int
+kernal_sys (uint16_t sys)
+{
+    if (!kernal_isReady ()) return CPU_ESTATE;
+
+    // as JSR from the READY loop
+    cpu_push16 (cpu.PC - 1);
+    cpu.PC = sys;
+    return CPU_OK;
+}
+
+int
+kernal_loadPrg (const char *file, enum kernal_run run, uint16_t sys)
+{
+    static const uint8_t run_keys[] = { 'R', 'U', 'N', 0x0D };
+    uint16_t start;
+    uint32_t len;
+
+    if (!kernal_isReady ()) return CPU_ESTATE;
+
+    int err = cpu_loadImage (file, CPU_IMG_PRG, CPU_IMG_HEADER, 0, &start, &len);
+    if (err != CPU_OK) return err;
+
+    uint16_t end = start + len;
+    kernal_poke16 (0xAE, end);   // end of load
+    kernal_poke16 (0x2D, end);   // VARTAB
+    kernal_poke16 (0x2F, end);   // ARYTAB
+    kernal_poke16 (0x31, end);   // STREND
+
+    switch (run) {
+    case KERNAL_RUN_BASIC:
+        for (unsigned i = 0; i < sizeof (run_keys); i++) {
+            cpu_write (0x0277 + i, run_keys[i]);
+        }
+        cpu_write (0xC6, sizeof (run_keys));
+        break;
+
+    case KERNAL_RUN_SYS:
+        kernal_sys (sys);
+        break;
+
+    default:
+        break;
+    }
+    return CPU_OK;
+}
+
+// kernal traps
+
+#define CHROUT 0xFFD2
+#define LOAD   0xFFD5
+#define SAVE   0xFFD8
+
+// kernal zero page
+#define ZP_STATUS 0x90   // ST
+#define ZP_FNLEN  0xB7
+#define ZP_SA     0xB9
+#define ZP_FNADR  0xBB
+#define ZP_EAL    0xAE
+
+// kernal i/o errors
+#define ERR_FILE_NOT_FOUND  4
+#define ERR_NOT_OUTPUT_FILE 7
+
+static char  trap_dir[256];
+static FILE *trap_sink;
+
+static void
+kernal_rts (void)
+{
+    cpu.PC = cpu_pull16 () + 1;
+    cpu.cycle += 6;
+}
+
+// kernal style result: carry clear on success, else carry set and A = error
+static int
+kernal_result (int err)
+{
+    cpu.P.C = (err ? 1:0);
+    if (err) cpu.A = err;
+    kernal_rts ();
+    return 1;
+}
+
+// file name at (FNADR), PETSCII to a host name: letters lowercase, no path
+static void
+kernal_filename (char *name, size_t len)
+{
+    uint16_t fn = mem[ZP_FNADR] | (mem[ZP_FNADR + 1] << 8);
+    size_t n = 0;
+
+    for (int i = 0; i < mem[ZP_FNLEN] && n + 1 < len; i++) {
+        uint8_t c = mem[(uint16_t)(fn + i)];
+
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c == '/' || c < 0x20 || c > 0x7E) c = '_';
+        name[n++] = c;
+    }
+    name[n] = 0;
+}
+
+// NAME, NAME.prg or the first match of a trailing '*'
+static int
+kernal_findFile (const char *name, char *path, size_t len)
+{
+    size_t n = strlen (name);
+    FILE *f;
+
+    if (n && name[n - 1] == '*') {
+        DIR *d = opendir (trap_dir);
+        struct dirent *e;
+
+        if (!d) return -1;
+        while ((e = readdir (d))) {
+            if (e->d_name[0] != '.' && !strncasecmp (e->d_name, name, n - 1)) {
+                snprintf (path, len, "%s/%s", trap_dir, e->d_name);
+                closedir (d);
+                return 0;
+            }
+        }
+        closedir (d);
+        return -1;
+    }
+
+    snprintf (path, len, "%s/%s", trap_dir, name);
+    if ((f = fopen (path, "rb"))) {
+        fclose (f);
+        return 0;
+    }
+    snprintf (path, len, "%s/%s.prg", trap_dir, name);
+    if ((f = fopen (path, "rb"))) {
+        fclose (f);
+        return 0;
+    }
+    return -1;
+}
+
+// in:  A 0 load / 1 verify, X/Y load address if secondary address is 0
+// out: X/Y and EAL end address + 1
+static int
+kernal_trapLoad (void)
+{
+    char name[64], path[512];
+    uint16_t start;
+    uint32_t len;
+
+    kernal_filename (name, sizeof (name));
+    if (!name[0] || kernal_findFile (name, path, sizeof (path))) {
+        return kernal_result (ERR_FILE_NOT_FOUND);
+    }
+
+    int address = (mem[ZP_SA] == 0 ? cpu.X | (cpu.Y << 8) : CPU_IMG_HEADER);
+
+    if (cpu.A) {
+        // verify: load on a copy, compare
+        static uint8_t saved[CPU_MEMSIZE];
+        memcpy (saved, mem, CPU_MEMSIZE);
+
+        if (cpu_loadImage (path, CPU_IMG_PRG, address, 0, &start, &len) != CPU_OK) {
+            return kernal_result (ERR_FILE_NOT_FOUND);
+        }
+        int differ = memcmp (&saved[start], &mem[start], len);
+        cpu_memLoad (saved);
+        cpu_write (ZP_STATUS, differ ? 0x10:0x00);
+    } else {
+        if (cpu_loadImage (path, CPU_IMG_PRG, address, 0, &start, &len) != CPU_OK) {
+            return kernal_result (ERR_FILE_NOT_FOUND);
+        }
+        cpu_write (ZP_STATUS, 0x00);
+    }
+
+    uint16_t end = start + len;
+    cpu_write (ZP_EAL, end & 0xFF);
+    cpu_write (ZP_EAL + 1, end >> 8);
+    cpu.X = end & 0xFF;
+    cpu.Y = end >> 8;
+
+    return kernal_result (0);
+}
+
+// in: A zero page pointer to the start address, X/Y end address + 1
+static int
+kernal_trapSave (void)
+{
+    char name[64], path[512];
+
+    kernal_filename (name, sizeof (name));
+    if (!name[0]) return kernal_result (ERR_NOT_OUTPUT_FILE);
+
+    size_t n = strlen (name);
+    snprintf (path, sizeof (path), "%s/%s%s", trap_dir, name, (n > 4 && !strcmp (name + n - 4, ".prg")) ? "":".prg");
+
+    uint16_t start = mem[cpu.A] | (mem[(uint8_t)(cpu.A + 1)] << 8);
+    uint16_t end   = cpu.X | (cpu.Y << 8);
+
+    FILE *f = fopen (path, "wb");
+    if (!f) return kernal_result (ERR_NOT_OUTPUT_FILE);
+
+    fputc (start & 0xFF, f);
+    fputc (start >> 8, f);
+    if (end > start) fwrite (&mem[start], end - start, 1, f);
+
+    int err = ferror (f);
+    if (fclose (f) || err) return kernal_result (ERR_NOT_OUTPUT_FILE);
+
+    cpu_write (ZP_STATUS, 0x00);
+    return kernal_result (0);
+}
+
+// A, X, Y are preserved. CHR$(14) / CHR$(142) switch the charset, as on screen
+static int
+kernal_trapChrout (void)
+{
+    static int lower;
+
+    if (cpu.A == 0x0E) lower = 1;
+    if (cpu.A == 0x8E) lower = 0;
+
+    fputs (lower? petscii_utf8_lower[cpu.A]:petscii_utf8[cpu.A], trap_sink);
+
+    cpu.P.C = 0;
+    kernal_rts ();
+    return 1;
+}
+
+int
+kernal_traps (const char *dir, FILE *sink)
+{
+    kernal_trapsOff ();
+
+    if (dir) {
+        snprintf (trap_dir, sizeof (trap_dir), "%s", dir);
+        if (cpu_setTrap (LOAD, kernal_trapLoad) != CPU_OK || cpu_setTrap (SAVE, kernal_trapSave) != CPU_OK) {
+            return CPU_EFULL;
+        }
+    }
+    if (sink) {
+        trap_sink = sink;
+        if (cpu_setTrap (CHROUT, kernal_trapChrout) != CPU_OK) return CPU_EFULL;
+    }
+    return CPU_OK;
+}
+
+void
+kernal_trapsOff (void)
+{
+    cpu_setTrap (LOAD, NULL);
+    cpu_setTrap (SAVE, NULL);
+    cpu_setTrap (CHROUT, NULL);
+    trap_sink = NULL;
+}
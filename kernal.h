@@ -0,0 +1,63 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef KERNAL_H
+#define KERNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// c64 kernal helpers, they work on the stock rom/kernal.rom (901227-03)
+// https://www.pagetable.com/c64ref/c64disasm/
+
+// fast boot
+// the slow init routines (RAMTAS ram test, CINT screen init) are run once and
+// memoized: the machine state on entry is hashed, the state on return is kept.
+// the next time the routine is entered with the same state the result is
+// loaded back in one go, so registers, memory and cycle count are exactly what
+// running it would give. with a cache file the results survive the process.
+extern int  kernal_fastboot    (const char *cachefile);
+extern void kernal_fastbootOff (void);
+
+// READY: the screen editor is waiting for a key (GETIN loop at $E5CD)
+extern int kernal_isReady    (void);
+extern int kernal_runToReady (uint64_t cycles);
+
+// program injection, at READY only
+// the .prg goes at its load address, BASIC pointers $2D-$32 (VARTAB, ARYTAB,
+// STREND) are set past its end, then it is started right away:
+// KERNAL_RUN_BASIC "RUN" + RETURN is put in the keyboard buffer ($0277, $C6)
+// KERNAL_RUN_SYS   jump to 'sys', an RTS comes back to READY
+enum kernal_run {
+	KERNAL_RUN_NONE,
+	KERNAL_RUN_BASIC,
+	KERNAL_RUN_SYS
+};
+
+extern int kernal_loadPrg (const char *file, enum kernal_run run, uint16_t sys);
+
+// SYS sys at READY: a jump there, an RTS comes back to READY
+extern int kernal_sys     (uint16_t sys);
+
+// kernal traps
+// LOAD ($FFD5) and SAVE ($FFD8) read and write .prg files in 'dir' on the host,
+// whatever the device number. CHROUT ($FFD2) goes to 'sink' as UTF-8 instead of
+// the screen. each one runs natively, sets registers/flags/status ($90) as the
+// kernal would, then returns with an RTS. either argument can be NULL
+extern int  kernal_traps    (const char *dir, FILE *sink);
+extern void kernal_trapsOff (void);
+
+#endif // KERNAL_H
@@ -0,0 +1,625 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "input.h"
+#include "profile.h"
+#include "stats.h"
+#include "lockstep.h"
+
+// the loops run over the lanes in use rounded up to LOCKSTEP_VEC, in blocks
+// of a fixed count the compiler turns into whole vectors (no scalar tail): a
+// lane out of the group (or past n) keeps its old value (on is 0x00)
+#define LANES(i)                                                  \
+    for (int i##_b = 0; i##_b < ls->width; i##_b += LOCKSTEP_VEC) \
+        for (int i = i##_b; i < i##_b + LOCKSTEP_VEC; i++)
+
+#define AM_LOAD  1
+#define AM_STORE 0
+
+// N V C Z, as cpu_BRANCH
+static const uint8_t branch_flag[4] = { 0x80, 0x40, 0x01, 0x02 };
+
+static inline uint8_t
+lockstep_pick (uint8_t on, uint8_t value, uint8_t old)
+{
+    return (value & on) | (old & ~on);
+}
+
+// N and Z from value
+static inline uint8_t
+lockstep_nz (uint8_t p, uint8_t value)
+{
+    return (p & 0x7D) | (value & 0x80) | ((value == 0) << 1);
+}
+
+// register = value, N Z
+static void
+lockstep_ld (struct lockstep *ls, uint8_t *reg, const uint8_t *value)
+{
+    LANES (i) {
+        reg[i]   = lockstep_pick (ls->on[i], value[i], reg[i]);
+        ls->P[i] = lockstep_pick (ls->on[i], lockstep_nz (ls->P[i], value[i]), ls->P[i]);
+    }
+}
+
+// C = reg >= value, N Z from reg - value
+static void
+lockstep_cmp (struct lockstep *ls, const uint8_t *reg, const uint8_t *value)
+{
+    LANES (i) {
+        uint8_t p = (lockstep_nz (ls->P[i], reg[i] - value[i]) & 0xFE) | (reg[i] >= value[i]);
+        ls->P[i] = lockstep_pick (ls->on[i], p, ls->P[i]);
+    }
+}
+
+// ADC SBC in decimal mode are left to cpu_op
+static int
+lockstep_decimal (const struct lockstep *ls)
+{
+    uint8_t d = 0;
+
+    LANES (i) d |= ls->on[i] & ls->P[i];
+    return (d & 0x08) != 0;
+}
+
+static void
+lockstep_flag (struct lockstep *ls, uint8_t and, uint8_t or)
+{
+    LANES (i) {
+        ls->P[i] = lockstep_pick (ls->on[i], (ls->P[i] & and) | or, ls->P[i]);
+    }
+}
+
+// effective address and, on a load, the operand of every lane in the group.
+// pen is the page cross cycle an indexed load pays
+static void
+lockstep_operand (struct lockstep *ls, uint8_t mode, uint8_t b1, uint8_t b2, int load,
+                  uint16_t *ea, uint8_t *value, uint8_t *pen)
+{
+    uint16_t abs = b1 | (b2 << 8);
+
+    switch (mode) {
+    case CPU_AM_IMM:
+        LANES (i) value[i] = b1;
+        return;
+    case CPU_AM_ZP:
+        LANES (i) ea[i] = b1;
+        break;
+    case CPU_AM_ZPX:
+        LANES (i) ea[i] = (uint8_t)(b1 + ls->X[i]);
+        break;
+    case CPU_AM_ZPY:
+        LANES (i) ea[i] = (uint8_t)(b1 + ls->Y[i]);
+        break;
+    case CPU_AM_ABS:
+        LANES (i) ea[i] = abs;
+        break;
+    case CPU_AM_ABSX:
+        LANES (i) ea[i] = abs + ls->X[i];
+        break;
+    case CPU_AM_ABSY:
+        LANES (i) ea[i] = abs + ls->Y[i];
+        break;
+    case CPU_AM_INDX:
+        LANES (i) {
+            uint8_t zp = b1 + ls->X[i];
+            ea[i] = (ls->on[i] ? ls->mem[i][zp] | (ls->mem[i][(uint8_t)(zp + 1)] << 8) : 0);
+        }
+        break;
+    case CPU_AM_INDY:
+        LANES (i) {
+            uint16_t base = (ls->on[i] ? ls->mem[i][b1] | (ls->mem[i][(uint8_t)(b1 + 1)] << 8) : 0);
+            ea[i]  = base + ls->Y[i];
+            pen[i] = load & (((base ^ ea[i]) >> 8) != 0);
+        }
+        break;
+    }
+
+    if (load && (mode == CPU_AM_ABSX || mode == CPU_AM_ABSY)) {
+        LANES (i) pen[i] = (((abs ^ ea[i]) >> 8) != 0);
+    }
+    if (load) {
+        LANES (i) value[i] = (ls->on[i] && ea[i] != CPU_RASTER ? ls->mem[i][ea[i]] : 0);
+    }
+}
+
+static void
+lockstep_store (struct lockstep *ls, const uint16_t *ea, const uint8_t *value)
+{
+    LANES (i) {
+        if (ls->on[i] && !mem_rom[ea[i] >> 8]) ls->mem[i][ea[i]] = value[i];
+    }
+}
+
+static void
+lockstep_push (struct lockstep *ls, const uint8_t *value)
+{
+    int rom = mem_rom[CPU_STACK >> 8];
+
+    LANES (i) {
+        if (!ls->on[i]) continue;
+        if (!rom) ls->mem[i][CPU_STACK + ls->SP[i]] = value[i];
+        ls->SP[i]--;
+    }
+}
+
+static void
+lockstep_pull (struct lockstep *ls, uint8_t *value)
+{
+    LANES (i) {
+        value[i] = (ls->on[i] ? ls->mem[i][CPU_STACK + ++ls->SP[i]] : 0);
+    }
+}
+
+// the group runs the lowest PC one of its lanes is at, with the lanes there
+// on and the others waiting. code mostly goes forward, so lanes a branch took
+// ahead (or out of a loop) wait at the join and go on together again
+static int
+lockstep_lead (struct lockstep *ls)
+{
+    int lead = -1;
+
+    for (int i = 0; i < ls->n; i++) {
+        if (ls->state[i] != LOCKSTEP_GROUP) continue;
+        if (lead < 0 || ls->PC[i] < ls->PC[lead]) lead = i;
+    }
+    if (lead < 0) return -1;
+
+    LANES (i) {
+        ls->on[i] = (i < ls->n && ls->state[i] == LOCKSTEP_GROUP && ls->PC[i] == ls->PC[lead] ? 0xFF : 0);
+    }
+    return lead;
+}
+
+// lanes whose bytes at pc differ from the lead's (self modifying code, an
+// input poked into the code) drop out
+static void
+lockstep_code (struct lockstep *ls, uint16_t pc, uint8_t len, uint8_t op, uint8_t b1, uint8_t b2)
+{
+    uint16_t pc1 = pc + 1, pc2 = pc + 2;
+
+    LANES (i) {
+        if (!ls->on[i]) continue;
+
+        const uint8_t *m = ls->mem[i];
+        uint8_t diff = (m[pc] ^ op) | (len > 1 ? m[pc1] ^ b1 : 0) | (len > 2 ? m[pc2] ^ b2 : 0);
+
+        if (diff) {
+            ls->on[i]    = 0;
+            ls->state[i] = LOCKSTEP_SCALAR;
+        }
+    }
+}
+
+// one istruction for the group, as the cpu_op handler would. 0 when the
+// group can't do it
+static int
+lockstep_step (struct lockstep *ls, int lead, uint16_t pc)
+{
+    uint16_t ea[LOCKSTEP_LANES];
+    uint8_t  v[LOCKSTEP_LANES], pen[LOCKSTEP_LANES], tmp[LOCKSTEP_LANES];
+
+    uint8_t op = ls->mem[lead][pc];
+    uint8_t b1 = ls->mem[lead][(uint16_t)(pc + 1)];
+    uint8_t b2 = ls->mem[lead][(uint16_t)(pc + 2)];
+
+    uint8_t  mode  = ISA[op].mode;
+    uint8_t  clock = cpu_opTiming[op].clock;
+    uint16_t next  = pc + cpu_opTiming[op].step;
+
+    lockstep_code (ls, pc, ISA[op].ist_len, op, b1, b2);
+    memset (pen, 0, sizeof (pen));
+
+    switch (op) {
+    // loads
+    case 0xA9: case 0xA5: case 0xB5: case 0xAD: case 0xBD: case 0xB9: case 0xA1: case 0xB1:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        lockstep_ld (ls, ls->A, v);
+        break;
+    case 0xA2: case 0xA6: case 0xAE:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        lockstep_ld (ls, ls->X, v);
+        break;
+    case 0xA0: case 0xA4: case 0xB4: case 0xAC:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        lockstep_ld (ls, ls->Y, v);
+        break;
+
+    // stores
+    case 0x85: case 0x95: case 0x8D: case 0x9D: case 0x99: case 0x81: case 0x91:
+        lockstep_operand (ls, mode, b1, b2, AM_STORE, ea, v, pen);
+        lockstep_store (ls, ea, ls->A);
+        break;
+    case 0x86: case 0x8E:
+        lockstep_operand (ls, mode, b1, b2, AM_STORE, ea, v, pen);
+        lockstep_store (ls, ea, ls->X);
+        break;
+    case 0x84: case 0x94: case 0x8C:
+        lockstep_operand (ls, mode, b1, b2, AM_STORE, ea, v, pen);
+        lockstep_store (ls, ea, ls->Y);
+        break;
+
+    // alu
+    case 0x09: case 0x0D:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) v[i] |= ls->A[i];
+        lockstep_ld (ls, ls->A, v);
+        break;
+    case 0x29: case 0x35:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) v[i] &= ls->A[i];
+        lockstep_ld (ls, ls->A, v);
+        break;
+    case 0x49:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) v[i] ^= ls->A[i];
+        lockstep_ld (ls, ls->A, v);
+        break;
+    case 0x69:
+        if (lockstep_decimal (ls)) return 0;
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) {
+            uint16_t tot  = ls->A[i] + v[i] + (ls->P[i] & 1);
+            int16_t  vtot = (int8_t)ls->A[i] + (int8_t)v[i] + (ls->P[i] & 1);
+            uint8_t  p    = (lockstep_nz (ls->P[i], tot) & 0xBE) | (tot > 0xFF) | ((vtot < -128 || vtot > 127) << 6);
+
+            ls->A[i] = lockstep_pick (ls->on[i], tot, ls->A[i]);
+            ls->P[i] = lockstep_pick (ls->on[i], p, ls->P[i]);
+        }
+        break;
+    case 0xE9:
+        if (lockstep_decimal (ls)) return 0;
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) {
+            uint16_t tot = 0xFF + ls->A[i] - v[i] + (ls->P[i] & 1);
+            uint8_t  ov  = ((ls->A[i] ^ v[i]) & 0x80) && !(tot < 0x80 || tot >= 0x180);
+            uint8_t  p   = (lockstep_nz (ls->P[i], tot) & 0xBE) | (tot >= 0x100) | (ov << 6);
+
+            ls->A[i] = lockstep_pick (ls->on[i], tot, ls->A[i]);
+            ls->P[i] = lockstep_pick (ls->on[i], p, ls->P[i]);
+        }
+        break;
+    case 0xC9: case 0xD1: case 0xDD:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        lockstep_cmp (ls, ls->A, v);
+        break;
+    case 0xE0:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        lockstep_cmp (ls, ls->X, v);
+        break;
+    case 0xC0:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        lockstep_cmp (ls, ls->Y, v);
+        break;
+    case 0x24:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) {
+            uint8_t p = (ls->P[i] & 0x3D) | (v[i] & 0xC0) | (((ls->A[i] & v[i]) == 0) << 1);
+            ls->P[i] = lockstep_pick (ls->on[i], p, ls->P[i]);
+        }
+        break;
+    case 0xE6:
+        lockstep_operand (ls, mode, b1, b2, AM_LOAD, ea, v, pen);
+        LANES (i) v[i]++;
+        lockstep_store (ls, ea, v);
+        LANES (i) ls->P[i] = lockstep_pick (ls->on[i], lockstep_nz (ls->P[i], v[i]), ls->P[i]);
+        break;
+
+    // shifts on A
+    case 0x0A:
+    case 0x4A:
+    case 0x2A:
+    case 0x6A:
+        LANES (i) {
+            uint8_t c = ls->P[i] & 1;
+
+            tmp[i] = (op == 0x0A || op == 0x2A ? ls->A[i] >> 7 : ls->A[i] & 1);
+            v[i]   = (op == 0x0A ? ls->A[i] << 1 : op == 0x4A ? ls->A[i] >> 1 :
+                      op == 0x2A ? (ls->A[i] << 1) | c : (ls->A[i] >> 1) | (c << 7));
+        }
+        lockstep_ld (ls, ls->A, v);
+        LANES (i) ls->P[i] = lockstep_pick (ls->on[i], (ls->P[i] & 0xFE) | tmp[i], ls->P[i]);
+        break;
+
+    // transfers, counters
+    case 0xAA: lockstep_ld (ls, ls->X, ls->A);  break;
+    case 0xA8: lockstep_ld (ls, ls->Y, ls->A);  break;
+    case 0x8A: lockstep_ld (ls, ls->A, ls->X);  break;
+    case 0x98: lockstep_ld (ls, ls->A, ls->Y);  break;
+    case 0xBA: lockstep_ld (ls, ls->X, ls->SP); break;
+    case 0x9A:
+        LANES (i) ls->SP[i] = lockstep_pick (ls->on[i], ls->X[i], ls->SP[i]);
+        break;
+    case 0xE8: LANES (i) v[i] = ls->X[i] + 1; lockstep_ld (ls, ls->X, v); break;
+    case 0xC8: LANES (i) v[i] = ls->Y[i] + 1; lockstep_ld (ls, ls->Y, v); break;
+    case 0xCA: LANES (i) v[i] = ls->X[i] - 1; lockstep_ld (ls, ls->X, v); break;
+    case 0x88: LANES (i) v[i] = ls->Y[i] - 1; lockstep_ld (ls, ls->Y, v); break;
+
+    // flags
+    case 0x18: lockstep_flag (ls, 0xFE, 0x00); break;
+    case 0x38: lockstep_flag (ls, 0xFF, 0x01); break;
+    case 0x58: lockstep_flag (ls, 0xFB, 0x00); break;
+    case 0x78: lockstep_flag (ls, 0xFF, 0x04); break;
+    case 0xB8: lockstep_flag (ls, 0xBF, 0x00); break;
+    case 0xD8: lockstep_flag (ls, 0xF7, 0x00); break;
+    case 0xF8: lockstep_flag (ls, 0xFF, 0x08); break;
+    case 0xEA: break;
+
+    // stack
+    case 0x48:
+        lockstep_push (ls, ls->A);
+        break;
+    case 0x08:
+        LANES (i) v[i] = ls->P[i] | 0x10;
+        lockstep_push (ls, v);
+        break;
+    case 0x68:
+        lockstep_pull (ls, v);
+        lockstep_ld (ls, ls->A, v);
+        break;
+    case 0x28:
+        lockstep_pull (ls, v);
+        LANES (i) ls->P[i] = lockstep_pick (ls->on[i], (v[i] & 0xCF) | (ls->P[i] & 0x30), ls->P[i]);
+        break;
+
+    // jumps
+    case 0x4C:
+        next = b1 | (b2 << 8);
+        break;
+    case 0x20:
+        LANES (i) v[i] = (pc + 2) >> 8;
+        lockstep_push (ls, v);
+        LANES (i) v[i] = (pc + 2) & 0xFF;
+        lockstep_push (ls, v);
+        next = b1 | (b2 << 8);
+        break;
+    case 0x60:
+        lockstep_pull (ls, v);
+        lockstep_pull (ls, tmp);
+        LANES (i) {
+            ls->PC[i]     = (ls->on[i] ? (v[i] | (tmp[i] << 8)) + 1 : ls->PC[i]);
+            ls->cycle[i] += ls->on[i] & clock;
+        }
+        return 1;
+
+    // branches: taken lanes and the others part
+    case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0: {
+        uint8_t  flag   = branch_flag[op >> 6];
+        uint8_t  want   = (op >> 5) & 1;
+        uint16_t target = next + (int8_t)b1;
+        uint8_t  extra  = 1 + ((next ^ target) > 0xFF);
+
+        LANES (i) {
+            uint8_t taken = (((ls->P[i] & flag) != 0) == want);
+
+            ls->PC[i]     = (ls->on[i] ? (taken ? target : next) : ls->PC[i]);
+            ls->cycle[i] += ls->on[i] & (clock + (taken ? extra : 0));
+        }
+        return 1;
+    }
+
+    default:
+        return 0;
+    }
+
+    LANES (i) {
+        ls->PC[i]     = (ls->on[i] ? next : ls->PC[i]);
+        ls->cycle[i] += ls->on[i] & (clock + pen[i]);
+    }
+    return 1;
+}
+
+// breakpoints and watchpoints are per machine, a lane can't have them
+static int
+lockstep_debugOn (void)
+{
+    if (debug_stackOn) return 1;
+
+    for (int p = 0; p < 256; p++) {
+        if (debug_page[p]) return 1;
+    }
+    return 0;
+}
+
+// copy the lane in and out of the machine. rom pages are the same everywhere
+// (and mapped read only)
+static void
+lockstep_memIn (const uint8_t *from)
+{
+    for (int p = 0; p < CPU_MEMSIZE >> 8; p++) {
+        if (!mem_rom[p]) memcpy (&mem[p << 8], &from[p << 8], 256);
+    }
+}
+
+// a lane on its own, on the machine
+static void
+lockstep_scalar (struct lockstep *ls, int i)
+{
+    lockstep_memIn (ls->mem[i]);
+
+    cpu.A      = ls->A[i];
+    cpu.X      = ls->X[i];
+    cpu.Y      = ls->Y[i];
+    cpu.SP     = ls->SP[i];
+    cpu.P.P    = ls->P[i];
+    cpu.PC     = ls->PC[i];
+    cpu.cycle  = ls->cycle[i];
+    cpu.tcycle = 0;
+    cpu.intr   = 0;
+
+    debug_stop = 0;
+    while (cpu.cycle < ls->end[i] && cpu.PC != ls->stop && !debug_stop) {
+        ls->scalar_istr += cpu_istr ();
+    }
+    debug_sync ();
+
+    memcpy (ls->mem[i], mem, CPU_MEMSIZE);
+    ls->A[i]     = cpu.A;
+    ls->X[i]     = cpu.X;
+    ls->Y[i]     = cpu.Y;
+    ls->SP[i]    = cpu.SP;
+    ls->P[i]     = cpu.P.P;
+    ls->PC[i]    = cpu.PC;
+    ls->cycle[i] = cpu.cycle;
+
+    if (debug_stop) {
+        ls->state[i] = LOCKSTEP_HIT;
+        ls->hit[i]   = debug_hit;
+    } else {
+        ls->state[i] = (cpu.PC == ls->stop ? LOCKSTEP_STOP : LOCKSTEP_BUDGET);
+    }
+}
+
+void
+lockstep_run (struct lockstep *ls, uint64_t cycles)
+{
+    int      solo   = lockstep_debugOn ();
+    uint64_t istr   = ls->group_istr + ls->scalar_istr;
+    uint64_t cycle0 = 0;
+    int      nscalar = 0;
+
+    LANES (i) {
+        ls->on[i] = 0;
+        if (i >= ls->n) continue;
+
+        cycle0      += ls->cycle[i];
+        ls->end[i]   = ls->cycle[i] + cycles;
+        ls->state[i] = (solo ? LOCKSTEP_SCALAR : LOCKSTEP_GROUP);
+    }
+
+    for (;;) {
+        for (int i = 0; i < ls->n; i++) {
+            if (ls->state[i] != LOCKSTEP_GROUP) continue;
+
+            if (ls->cycle[i] >= ls->end[i]) ls->state[i] = LOCKSTEP_BUDGET;
+            else if (ls->PC[i] == ls->stop) ls->state[i] = LOCKSTEP_STOP;
+        }
+
+        int lead = lockstep_lead (ls);
+        if (lead < 0) break;
+
+        uint16_t pc = ls->PC[lead];
+
+        uint64_t n = 0;
+        LANES (i) n += ls->on[i] & 1;
+
+        if (cpu_trapPage[pc >> 8] || !lockstep_step (ls, lead, pc)) {
+            LANES (i) {
+                if (ls->on[i]) ls->state[i] = LOCKSTEP_SCALAR;
+                ls->on[i] = 0;
+            }
+            continue;
+        }
+        ls->group_istr += n;
+    }
+
+    for (int i = 0; i < ls->n; i++) {
+        nscalar += (ls->state[i] == LOCKSTEP_SCALAR);
+    }
+
+    // the dropped lanes borrow the machine one at a time, it's put back after
+    if (nscalar) {
+        struct Tcpu      c = cpu;
+        struct debug_hit h = debug_hit;
+        uint8_t          stop = debug_stop;
+        uint64_t         next = input_next;
+        uint8_t          prof = profile_on;
+        uint8_t          dirty[CPU_MEMSIZE >> 8];
+
+        memcpy (ls->save, mem, CPU_MEMSIZE);
+        memcpy (dirty, mem_dirty, sizeof (dirty));
+        input_next = UINT64_MAX;
+        profile_on = 0;                 // the lanes aren't the machine, keep them out of its profile
+
+        for (int i = 0; i < ls->n; i++) {
+            if (ls->state[i] == LOCKSTEP_SCALAR) lockstep_scalar (ls, i);
+        }
+
+        lockstep_memIn (ls->save);
+        memcpy (mem_dirty, dirty, sizeof (dirty));
+        cpu        = c;
+        debug_hit  = h;
+        debug_stop = stop;
+        input_next = next;
+        profile_on = prof;
+    }
+
+    struct stats *s = stats_thread ();
+    uint64_t cycle1 = 0;
+
+    for (int i = 0; i < ls->n; i++) {
+        cycle1 += ls->cycle[i];
+    }
+    stats_add (&s->istr, ls->group_istr + ls->scalar_istr - istr);
+    stats_add (&s->cycles, cycle1 - cycle0);
+}
+
+void
+lockstep_reset (struct lockstep *ls)
+{
+    for (int i = 0; i < ls->n; i++) {
+        memcpy (ls->mem[i], mem, CPU_MEMSIZE);
+
+        ls->A[i]     = cpu.A;
+        ls->X[i]     = cpu.X;
+        ls->Y[i]     = cpu.Y;
+        ls->SP[i]    = cpu.SP;
+        ls->P[i]     = cpu.P.P;
+        ls->PC[i]    = cpu.PC;
+        ls->cycle[i] = cpu.cycle;
+        ls->state[i] = LOCKSTEP_BUDGET;
+    }
+}
+
+int
+lockstep_init (struct lockstep *ls, int n)
+{
+    memset (ls, 0, sizeof (*ls));
+    if (n < 1 || n > LOCKSTEP_LANES) return CPU_ESIZE;
+
+    ls->base = aligned_alloc (4096, (size_t)n * CPU_MEMSIZE);
+    ls->save = aligned_alloc (4096, CPU_MEMSIZE);
+    if (!ls->base || !ls->save) {
+        lockstep_free (ls);
+        return CPU_ENOMEM;
+    }
+
+    ls->n     = n;
+    ls->width = (n + LOCKSTEP_VEC - 1) & ~(LOCKSTEP_VEC - 1);
+    ls->stop  = -1;
+    for (int i = 0; i < n; i++) {
+        ls->mem[i] = ls->base + (size_t)i * CPU_MEMSIZE;
+    }
+
+    lockstep_reset (ls);
+    return CPU_OK;
+}
+
+void
+lockstep_free (struct lockstep *ls)
+{
+    free (ls->base);
+    free (ls->save);
+
+    ls->base = NULL;
+    ls->save  = NULL;
+    ls->n     = 0;
+    ls->width = 0;
+}
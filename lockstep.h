@@ -0,0 +1,91 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "debug.h"
+
+// many machines, one program
+//
+// up to LOCKSTEP_LANES copies of the machine (same program, different inputs)
+// run as a group while they are at the same PC: registers are arrays, one
+// lane per machine, and every istruction is a loop over all the lanes with a
+// mask, so register and flag work is done LOCKSTEP_LANES at a time.
+// lanes a branch parts wait while the group runs the lowest PC, and are back
+// in it when they get to the same PC again. a lane with different code bytes
+// drops out and runs on its own through cpu_istr later, as do the lanes on
+// an opcode the group can't do (BRK, RTI, JMP (ind), ADC / SBC in decimal
+// mode, not implemented) or on a trap page. with breakpoints, watchpoints
+// or stack checks set every lane runs on its own.
+// lanes get no host input, a trap runs on the lane's own run.
+// each lane has its own 64 KiB, the caller pokes the inputs in (mem[lane],
+// registers) after lockstep_reset
+
+#define LOCKSTEP_LANES 64
+#define LOCKSTEP_VEC   16       // lanes a step works on at least, a 16 byte vector of u8
+
+// lane state after lockstep_run
+enum lockstep_state {
+	LOCKSTEP_GROUP,         // with the group, on or waiting (only while running)
+	LOCKSTEP_SCALAR,        // dropped out, waits for its own run
+	LOCKSTEP_BUDGET,        // cycles spent
+	LOCKSTEP_STOP,          // got to the stop PC
+	LOCKSTEP_HIT            // a debug stop on its own run, see hit
+};
+
+struct lockstep {
+	uint8_t  A[LOCKSTEP_LANES]  __attribute__ ((aligned (64)));
+	uint8_t  X[LOCKSTEP_LANES]  __attribute__ ((aligned (64)));
+	uint8_t  Y[LOCKSTEP_LANES]  __attribute__ ((aligned (64)));
+	uint8_t  SP[LOCKSTEP_LANES] __attribute__ ((aligned (64)));
+	uint8_t  P[LOCKSTEP_LANES]  __attribute__ ((aligned (64)));
+	uint16_t PC[LOCKSTEP_LANES] __attribute__ ((aligned (64)));
+	uint64_t cycle[LOCKSTEP_LANES];
+	uint64_t end[LOCKSTEP_LANES];
+
+	// 0xFF: the lane is in this step of the group
+	uint8_t  on[LOCKSTEP_LANES] __attribute__ ((aligned (64)));
+	uint8_t  state[LOCKSTEP_LANES];
+
+	uint8_t *mem[LOCKSTEP_LANES];
+	struct debug_hit hit[LOCKSTEP_LANES];
+
+	int      n;                 // lanes in use
+	int      width;             // n rounded up to LOCKSTEP_VEC
+	int      stop;              // a lane is done when its PC gets here, -1 never
+
+	uint64_t group_istr;        // istructions (one per lane) done by the group
+	uint64_t scalar_istr;       // and by lanes on their own
+
+	uint8_t *base;              // lane memory, n * 64 KiB
+	uint8_t *save;              // the machine, while a lane borrows it
+};
+
+// n lanes, each a copy of the machine as it is now. return a cpu_err
+extern int  lockstep_init  (struct lockstep *ls, int n);
+extern void lockstep_free  (struct lockstep *ls);
+
+// every lane back to a copy of the machine
+extern void lockstep_reset (struct lockstep *ls);
+
+// run every lane until at least 'cycles' more cycles are spent or it gets to
+// ls->stop. the machine (cpu, mem) is the same after as before
+extern void lockstep_run   (struct lockstep *ls, uint64_t cycles);
+
+#endif // LOCKSTEP_H
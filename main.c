@@ -16,38 +16,921 @@
 
 
 // I'm too lazy for a cmakefile
-// gcc -Wall cpu.c main.c -o cpu `pkg-config --cflags --libs glib-2.0`
+// gcc -Wall cpu.c state.c input.c kernal.c petscii.c debug.c gdbstub.c disasm.c profile.c stats.c lockstep.c fuzz.c daemon.c main.c -o cpu
+// add -DCPU_CYCLE_STEPPED to default to the cycle stepped core
+// add -DCPU_NODEBUG to build without breakpoint / watchpoint checks
+// add -O3 -march=native so the lockstep lanes get the widest vectors the host has
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "cpu.h"
+#include "kernal.h"
+#include "gdbstub.h"
+#include "profile.h"
+#include "stats.h"
+#include "state.h"
+#include "daemon.h"
+#include "fuzz.h"
+#include "lockstep.h"
 
-int 
-main (int argc, char const *argv[])
+#define MAXROM   16
+#define MAXJOB   64
+#define MAXARG   64
+
+// with no budget given: the boot trace as far as it goes right now
+#define DEFAULT_ISTR 11800
+
+enum stats_fmt {
+	STATS_TEXT,
+	STATS_PROM,
+	STATS_NONE
+};
+
+struct rom {
+	uint16_t    address;
+	const char *file;
+	int         shared;     // cpu_mapRom, else cpu_addRom
+};
+
+struct opts {
+	struct rom  rom[MAXROM];
+	int         nrom;
+
+	const char *prg;
+	int         pc;         // -1: the reset vector
+	double      freq;
+	uint64_t    frame;
+	int         core;
+	uint64_t    istr;
+	uint64_t    cycles;
+	int         trace;
+	int         pace;
+
+	const char *load;       // snapshots
+	const char *save;
+	int         stats;      // enum stats_fmt
+	int         profile;
+	const char *output;
+
+	const char *fastboot;
+	const char *traps;
+	const char *gdb;
+	const char *daemon;
+	int         workers;
+
+	const char *batch;
+	int         jobs;
+
+	int         lanes;      // lockstep copies, 0: one machine
+	int         until;      // -1: no stop pc
+	uint8_t     regs;       // input: FUZZ_A | FUZZ_X ..., then len bytes at address
+	uint16_t    address;
+	uint16_t    len;
+	uint64_t    seed;
+	int         check;
+
+	uint64_t    fuzz;       // execs, 0: no fuzzing
+	int         ret;        // -1: not given
+	struct fuzz_range allow[FUZZ_MAXALLOW];
+	uint8_t     nallow;
+};
+
+static const struct option longopts[] = {
+	{ "rom",      required_argument, NULL, 'r' },
+	{ "map",      required_argument, NULL, 'm' },
+	{ "prg",      required_argument, NULL, 'p' },
+	{ "pc",       required_argument, NULL, 'P' },
+	{ "pal",      no_argument,       NULL, 'A' },
+	{ "ntsc",     no_argument,       NULL, 'N' },
+	{ "core",     required_argument, NULL, 'C' },
+	{ "istr",     required_argument, NULL, 'i' },
+	{ "cycles",   required_argument, NULL, 'c' },
+	{ "trace",    required_argument, NULL, 't' },
+	{ "pace",     no_argument,       NULL, 'R' },
+	{ "load",     required_argument, NULL, 'l' },
+	{ "save",     required_argument, NULL, 's' },
+	{ "stats",    required_argument, NULL, 'S' },
+	{ "profile",  no_argument,       NULL, 'F' },
+	{ "output",   required_argument, NULL, 'o' },
+	{ "fastboot", required_argument, NULL, 'f' },
+	{ "traps",    required_argument, NULL, 'T' },
+	{ "gdb",      required_argument, NULL, 'g' },
+	{ "daemon",   required_argument, NULL, 'd' },
+	{ "workers",  required_argument, NULL, 'w' },
+	{ "batch",    required_argument, NULL, 'b' },
+	{ "jobs",     required_argument, NULL, 'j' },
+	{ "lanes",    required_argument, NULL, 'L' },
+	{ "until",    required_argument, NULL, 'U' },
+	{ "input",    required_argument, NULL, 'I' },
+	{ "regs",     required_argument, NULL, 'G' },
+	{ "seed",     required_argument, NULL, 'E' },
+	{ "check",    no_argument,       NULL, 'K' },
+	{ "fuzz",     required_argument, NULL, 'Z' },
+	{ "ret",      required_argument, NULL, 'Q' },
+	{ "allow",    required_argument, NULL, 'W' },
+	{ "help",     no_argument,       NULL, 'h' },
+	{ NULL,       0,                 NULL, 0 }
+};
+
+static void
+usage (FILE *out)
+{
+	fprintf (out,
+		"usage: cpu [options]\n"
+		"  -r, --rom ADDR:FILE     copy a rom in at ADDR (i/o can sit on top of it)\n"
+		"  -m, --map ADDR:FILE     map a shared read only rom at ADDR\n"
+		"                          none given: basic, character and kernal from rom/\n"
+		"  -p, --prg FILE          load a .prg, at READY through the kernal\n"
+		"      --pc ADDR           start there, not at the reset vector\n"
+		"      --pal, --ntsc       clock, pal by default\n"
+		"      --core fast|cycle   istruction or cycle stepped\n"
+		"  -i, --istr N            istruction budget\n"
+		"  -c, --cycles N          cycle budget, 0 no limit. none: -i %d\n"
+		"  -t, --trace N           0 quiet, 1 every istruction (default)\n"
+		"      --pace              real speed\n"
+		"  -l, --load FILE         start from a snapshot (same roms)\n"
+		"  -s, --save FILE         snapshot at the end\n"
+		"      --stats FMT         text (default), prom or none\n"
+		"      --profile           where the cycles went, at the end\n"
+		"  -o, --output FILE       all output there\n"
+		"      --fastboot FILE     memoize the kernal boot in FILE\n"
+		"      --traps DIR         LOAD/SAVE on DIR, CHROUT on the output\n"
+		"      --gdb WHERE         gdb remote on a port or unix socket, no budget\n"
+		"      --daemon PATH       after the run (and on to READY), serve jobs on a\n"
+		"                          unix socket\n"
+		"      --workers N         daemon processes (default 4)\n"
+		"  -b, --batch FILE        one job a line, its options on top of these\n"
+		"  -j, --jobs N            batch jobs at once (default 4)\n"
+		"      --lanes N           N copies in lockstep, each with its own input\n"
+		"      --until ADDR        a lane is done when it gets to ADDR\n"
+		"      --input ADDR:LEN    input bytes in memory\n"
+		"      --regs AXYP         input registers, first bytes of the input\n"
+		"      --seed N            random inputs, lane 0 keeps the machine's own\n"
+		"      --check             run every lane again on its own and compare\n"
+		"      --fuzz N            N runs of the routine at --pc with mutated inputs,\n"
+		"                          --cycles each (default a frame). ^C stops early\n"
+		"      --ret ADDR          where the routine's RTS lands (as a JSR at ADDR - 3)\n"
+		"      --allow FROM-TO     writes allowed there, anywhere else is a finding\n"
+		"                          (up to %d, none: writes aren't checked)\n"
+		"numbers are decimal, $hex or 0xhex\n", DEFAULT_ISTR, FUZZ_MAXALLOW);
+}
+
+// decimal, $hex or 0xhex. a leading 0 is still decimal
+static int
+parseNum (const char *s, uint64_t *value)
+{
+	char *end;
+	int   base = 10;
+
+	if (*s == '$') {
+		s++;
+		base = 16;
+	} else if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		s += 2;
+		base = 16;
+	}
+	if (!*s) return 0;
+
+	errno = 0;
+	*value = strtoull (s, &end, base);
+	return (!*end && !errno);
+}
+
+static int
+parseAddr (const char *s, uint16_t *address)
+{
+	uint64_t v;
+
+	if (!parseNum (s, &v) || v >= CPU_MEMSIZE) return 0;
+	*address = v;
+	return 1;
+}
+
+// ADDR:FILE
+static int
+parseRom (struct opts *o, char *arg, int shared)
+{
+	char *file = strchr (arg, ':');
+
+	if (!file || o->nrom == MAXROM) return 0;
+	*file++ = '\0';
+	if (!*file || !parseAddr (arg, &o->rom[o->nrom].address)) return 0;
+
+	o->rom[o->nrom].file   = file;
+	o->rom[o->nrom].shared = shared;
+	o->nrom++;
+	return 1;
+}
+
+// ADDR:LEN, in ram
+static int
+parseInput (struct opts *o, char *arg)
+{
+	char    *len = strchr (arg, ':');
+	uint64_t n;
+
+	if (!len) return 0;
+	*len++ = '\0';
+	if (!parseAddr (arg, &o->address) || !parseNum (len, &n) || !n || o->address + n > CPU_MEMSIZE) return 0;
+
+	o->len = n;
+	return 1;
+}
+
+// FROM-TO, inclusive
+static int
+parseAllow (struct opts *o, char *arg)
+{
+	char *to = strchr (arg, '-');
+
+	if (!to || o->nallow == FUZZ_MAXALLOW) return 0;
+	*to++ = '\0';
+	if (!parseAddr (arg, &o->allow[o->nallow].from) || !parseAddr (to, &o->allow[o->nallow].to)) return 0;
+	if (o->allow[o->nallow].to < o->allow[o->nallow].from) return 0;
+
+	o->nallow++;
+	return 1;
+}
+
+static int
+parseRegs (struct opts *o, const char *arg)
+{
+	o->regs = 0;
+	for (; *arg; arg++) {
+		switch (*arg) {
+		case 'A': case 'a': o->regs |= FUZZ_A; break;
+		case 'X': case 'x': o->regs |= FUZZ_X; break;
+		case 'Y': case 'y': o->regs |= FUZZ_Y; break;
+		case 'P': case 'p': o->regs |= FUZZ_P; break;
+		default: return 0;
+		}
+	}
+	return 1;
+}
+
+static int
+inputLen (const struct opts *o)
+{
+	return __builtin_popcount (o->regs) + o->len;
+}
+
+static void
+defaults (struct opts *o)
+{
+	memset (o, 0, sizeof (*o));
+	o->pc      = -1;
+	o->freq    = CPU_PAL_HZ;
+	o->frame   = CPU_PAL_FRAME;
+	o->core    = CPU_CORE_DEFAULT;
+	o->trace   = 1;
+	o->workers = 4;
+	o->jobs    = 4;
+	o->until   = -1;
+	o->ret     = -1;
+}
+
+// on top of what's in o already. 0 on a bad option
+static int
+parseArgs (struct opts *o, int argc, char **argv)
+{
+	int      c;
+	uint64_t n;
+	uint16_t address;
+
+	optind = 0;
+	while ((c = getopt_long (argc, argv, "r:m:p:i:c:t:l:s:o:b:j:h", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'r':
+		case 'm':
+			if (!parseRom (o, optarg, c == 'm')) {
+				fprintf (stderr, "bad rom %s, ADDR:FILE\n", optarg);
+				return 0;
+			}
+			break;
+		case 'p': o->prg = optarg; break;
+		case 'P':
+			if (!parseAddr (optarg, &address)) {
+				fprintf (stderr, "bad pc %s\n", optarg);
+				return 0;
+			}
+			o->pc = address;
+			break;
+		case 'A': o->freq = CPU_PAL_HZ;  o->frame = CPU_PAL_FRAME;  break;
+		case 'N': o->freq = CPU_NTSC_HZ; o->frame = CPU_NTSC_FRAME; break;
+		case 'C':
+			if (!strcmp (optarg, "fast")) {
+				o->core = CPU_CORE_FAST;
+			} else if (!strcmp (optarg, "cycle")) {
+				o->core = CPU_CORE_CYCLE;
+			} else {
+				fprintf (stderr, "bad core %s, fast or cycle\n", optarg);
+				return 0;
+			}
+			break;
+		case 'i':
+		case 'c':
+		case 't':
+		case 'w':
+		case 'j':
+			if (!parseNum (optarg, &n)) {
+				fprintf (stderr, "bad number %s\n", optarg);
+				return 0;
+			}
+			if (c == 'i') o->istr    = n;
+			if (c == 'c') o->cycles  = n;
+			if (c == 't') o->trace   = (n != 0);
+			if (c == 'w') o->workers = n;
+			if (c == 'j') o->jobs    = n;
+			break;
+		case 'L':
+			if (!parseNum (optarg, &n) || n < 1 || n > LOCKSTEP_LANES) {
+				fprintf (stderr, "lanes 1 to %d\n", LOCKSTEP_LANES);
+				return 0;
+			}
+			o->lanes = n;
+			break;
+		case 'U':
+			if (!parseAddr (optarg, &address)) {
+				fprintf (stderr, "bad address %s\n", optarg);
+				return 0;
+			}
+			o->until = address;
+			break;
+		case 'I':
+			if (!parseInput (o, optarg)) {
+				fprintf (stderr, "bad input %s, ADDR:LEN\n", optarg);
+				return 0;
+			}
+			break;
+		case 'G':
+			if (!parseRegs (o, optarg)) {
+				fprintf (stderr, "bad registers %s, any of AXYP\n", optarg);
+				return 0;
+			}
+			break;
+		case 'E':
+			if (!parseNum (optarg, &o->seed)) {
+				fprintf (stderr, "bad number %s\n", optarg);
+				return 0;
+			}
+			break;
+		case 'K': o->check = 1; break;
+		case 'Z':
+			if (!parseNum (optarg, &o->fuzz) || !o->fuzz) {
+				fprintf (stderr, "bad number %s\n", optarg);
+				return 0;
+			}
+			break;
+		case 'Q':
+			if (!parseAddr (optarg, &address)) {
+				fprintf (stderr, "bad address %s\n", optarg);
+				return 0;
+			}
+			o->ret = address;
+			break;
+		case 'W':
+			if (!parseAllow (o, optarg)) {
+				fprintf (stderr, "bad range %s, FROM-TO (up to %d)\n", optarg, FUZZ_MAXALLOW);
+				return 0;
+			}
+			break;
+		case 'R': o->pace = 1; break;
+		case 'l': o->load = optarg; break;
+		case 's': o->save = optarg; break;
+		case 'S':
+			if (!strcmp (optarg, "text")) {
+				o->stats = STATS_TEXT;
+			} else if (!strcmp (optarg, "prom")) {
+				o->stats = STATS_PROM;
+			} else if (!strcmp (optarg, "none")) {
+				o->stats = STATS_NONE;
+			} else {
+				fprintf (stderr, "bad stats format %s, text prom or none\n", optarg);
+				return 0;
+			}
+			break;
+		case 'F': o->profile  = 1; break;
+		case 'o': o->output   = optarg; break;
+		case 'f': o->fastboot = optarg; break;
+		case 'T': o->traps    = optarg; break;
+		case 'g': o->gdb      = optarg; break;
+		case 'd': o->daemon   = optarg; break;
+		case 'b': o->batch    = optarg; break;
+		case 'h':
+			usage (stdout);
+			exit (EXIT_SUCCESS);
+		default:
+			return 0;
+		}
+	}
+	if (optind < argc) {
+		fprintf (stderr, "what is %s?\n", argv[optind]);
+		return 0;
+	}
+	if (o->jobs < 1 || o->jobs > MAXJOB) {
+		fprintf (stderr, "jobs 1 to %d\n", MAXJOB);
+		return 0;
+	}
+	if (o->fuzz && (o->pc < 0 || o->ret < 0 || !inputLen (o))) {
+		fprintf (stderr, "fuzz needs --pc, --ret and an --input or --regs\n");
+		return 0;
+	}
+	if (inputLen (o) > FUZZ_MAXINPUT) {
+		fprintf (stderr, "input over %d bytes\n", FUZZ_MAXINPUT);
+		return 0;
+	}
+	return 1;
+}
+
+static void
+addRom (uint16_t address, const char *romfile, int shared)
+{
+	printf ("Adding $%04X %s%s", address, romfile, (shared ? " (shared)":""));
+
+	int err = (shared ? cpu_mapRom (address, romfile) : cpu_addRom (address, romfile, 0));
+	if (err != CPU_OK) {
+		printf (" ERROR! %s", cpu_strerror (err));
+	}
+	printf ("\n");
+}
+
+static int
+loadState (const char *file)
 {
+	FILE *f = fopen (file, "rb");
+	if (!f) return STATE_ESIZE;
+
+	size_t   len = state_size ();
+	uint8_t *buf = malloc (len);
+	int      err = STATE_ENOMEM;
+
+	if (buf) {
+		len = fread (buf, 1, len, f);
+		err = state_load (buf, len);
+		free (buf);
+	}
+	fclose (f);
+	return err;
+}
+
+static int
+saveState (const char *file)
+{
+	size_t   len = state_size ();
+	uint8_t *buf = malloc (len);
+	FILE    *f;
+	int      err = CPU_ENOMEM;
+
+	if (!buf) return err;
+	state_save (buf, len);
+
+	err = CPU_EIO;
+	if ((f = fopen (file, "wb"))) {
+		if (fwrite (buf, len, 1, f) == 1) err = CPU_OK;
+		if (fclose (f)) err = CPU_EIO;
+	}
+	free (buf);
+	return err;
+}
+
+static void
+onSignal (int sig)
+{
+	(void)sig;
+	daemon_stop ();
+}
+
+static volatile sig_atomic_t interrupted;
+
+static void
+onInterrupt (int sig)
+{
+	(void)sig;
+	interrupted = 1;
+	debug_interrupt ();
+}
+
+static double
+now (void)
+{
+	struct timespec t;
+
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint64_t
+splitmix (uint64_t *s)
+{
+	uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// the input goes to (or comes from) the registers first, A X Y P as asked,
+// then to memory
+static void
+inputPut (const struct opts *o, const uint8_t *in, uint8_t *a, uint8_t *x, uint8_t *y, uint8_t *p, uint8_t *m)
+{
+	if (o->regs & FUZZ_A) *a = *in++;
+	if (o->regs & FUZZ_X) *x = *in++;
+	if (o->regs & FUZZ_Y) *y = *in++;
+	if (o->regs & FUZZ_P) *p = *in++;
+	memcpy (&m[o->address], in, o->len);
+}
+
+static void
+inputGet (const struct opts *o, uint8_t *in)
+{
+	if (o->regs & FUZZ_A) *in++ = cpu.A;
+	if (o->regs & FUZZ_X) *in++ = cpu.X;
+	if (o->regs & FUZZ_Y) *in++ = cpu.Y;
+	if (o->regs & FUZZ_P) *in++ = cpu.P.P;
+	memcpy (in, &mem[o->address], o->len);
+}
+
+static int
+inputRam (const struct opts *o)
+{
+	for (uint32_t p = o->address >> 8; o->len && p <= (o->address + o->len - 1u) >> 8; p++) {
+		if (mem_rom[p]) return 0;
+	}
+	return 1;
+}
+
+// the machine as it is, o->lanes times, in lockstep. with check every lane
+// runs again alone on the machine and has to end up the same (registers,
+// cycle and every ram byte). exit code
+static int
+lanes (const struct opts *o, uint64_t cycles)
+{
+	static struct lockstep ls;
+	static uint8_t in[LOCKSTEP_LANES][FUZZ_MAXINPUT];
+	static const char *state_name[] = { "group", "scalar", "budget", "stop", "hit" };
+	uint64_t rng = o->seed;
+	int      n   = inputLen (o), err;
+
+	if (!inputRam (o)) {
+		fprintf (stderr, "the input is on a rom\n");
+		return EXIT_FAILURE;
+	}
+	if ((err = lockstep_init (&ls, o->lanes)) != CPU_OK) {
+		fprintf (stderr, "lockstep: %s\n", cpu_strerror (err));
+		return EXIT_FAILURE;
+	}
+	ls.stop = o->until;
+
+	inputGet (o, in[0]);
+	for (int i = 1; i < ls.n; i++) {
+		for (int k = 0; k < n; k++) in[i][k] = splitmix (&rng);
+		inputPut (o, in[i], &ls.A[i], &ls.X[i], &ls.Y[i], &ls.P[i], ls.mem[i]);
+	}
+
+	double t0 = now ();
+	lockstep_run (&ls, cycles);
+	double t1 = now ();
+
+	for (int i = 0; i < ls.n; i++) {
+		printf ("lane %2d: %-6s PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X CYC:%lu\n", i, state_name[ls.state[i]],
+				ls.PC[i], ls.A[i], ls.X[i], ls.Y[i], ls.SP[i], ls.P[i], (unsigned long)ls.cycle[i]);
+	}
+	if (o->stats == STATS_TEXT) {
+		printf ("lockstep: %d lanes, %lu group istr, %lu scalar istr in %.6fs\n", ls.n,
+				(unsigned long)ls.group_istr, (unsigned long)ls.scalar_istr, t1 - t0);
+	}
+
+	int bad = 0;
+
+	if (o->check) {
+		size_t   len  = state_size ();
+		uint8_t *snap = malloc (len);
+
+		if (!snap) {
+			lockstep_free (&ls);
+			return EXIT_FAILURE;
+		}
+		state_save (snap, len);
+
+		for (int i = 0; i < ls.n; i++) {
+			state_load (snap, len);
+			inputPut (o, in[i], &cpu.A, &cpu.X, &cpu.Y, &cpu.P.P, mem);
+
+			uint64_t end = cpu.cycle + cycles;
+
+			debug_stop = 0;
+			while (cpu.cycle < end && cpu.PC != ls.stop && !debug_stop) cpu_istr ();
+
+			int same = (cpu.A == ls.A[i] && cpu.X == ls.X[i] && cpu.Y == ls.Y[i] && cpu.SP == ls.SP[i] &&
+						cpu.P.P == ls.P[i] && cpu.PC == ls.PC[i] && cpu.cycle == ls.cycle[i]);
+
+			for (int p = 0; same && p < CPU_MEMSIZE >> 8; p++) {
+				same = (mem_rom[p] || !memcmp (&mem[p << 8], &ls.mem[i][p << 8], 256));
+			}
+			if (!same) {
+				printf ("lane %2d: differs alone, PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X CYC:%lu\n", i,
+						cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, cpu.P.P, (unsigned long)cpu.cycle);
+				bad++;
+			}
+		}
+		state_load (snap, len);
+		free (snap);
+		printf ("check: %d of %d lanes the same alone\n", ls.n - bad, ls.n);
+	}
+
+	lockstep_free (&ls);
+	return (bad ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+// the routine at o->pc, from the machine as it is. exit code, 1 when
+// something was found
+#define FUZZ_CHUNK 10000
+
+static int
+fuzz (const struct opts *o, uint64_t cycles)
+{
+	struct fuzz_spec   spec;
+	struct fuzz_status st;
+	struct sigaction   sa = { .sa_handler = onInterrupt }, old;
+	int err;
+
+	memset (&spec, 0, sizeof (spec));
+	spec.entry   = o->pc;
+	spec.ret     = o->ret;
+	spec.cycles  = cycles;
+	spec.seed    = o->seed;
+	spec.regs    = o->regs;
+	spec.address = o->address;
+	spec.len     = o->len;
+	spec.nallow  = o->nallow;
+	memcpy (spec.allow, o->allow, sizeof (spec.allow));
+
+	if ((err = fuzz_init (&spec, NULL, 0)) != CPU_OK) {
+		fprintf (stderr, "fuzz: %s\n", cpu_strerror (err));
+		return EXIT_FAILURE;
+	}
+
+	// a ^C that lands between two runs is seen by the next chunk
+	interrupted = 0;
+	sigaction (SIGINT, &sa, &old);
+	for (uint64_t done = 0; done < o->fuzz && !interrupted; done += FUZZ_CHUNK) {
+		fuzz_run (o->fuzz - done < FUZZ_CHUNK ? o->fuzz - done : FUZZ_CHUNK);
+	}
+	sigaction (SIGINT, &old, NULL);
+
+	fuzz_report (stdout);
+	fuzz_status (&st);
+	fuzz_free ();
+	return (st.nfind ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+// one machine, start to end. exit code
+static int
+run (const struct opts *o)
+{
+	int err, status = EXIT_SUCCESS;
+
+	if (o->output && !freopen (o->output, "w", stdout)) {
+		fprintf (stderr, "can't write %s\n", o->output);
+		return EXIT_FAILURE;
+	}
+
 	printf (PRG_NAME " release " PRG_RELEASE "\n");
 
-	cpu_init (CPU_PAL_HZ);
+	cpu_init (o->freq);
+	cpu_setCore (o->core);
 
-	cpu_addRom (0xA000, "rom/basic.rom", 0);
-	cpu_addRom (0xD000, "rom/character.rom", 0);	
-	cpu_addRom (0xE000, "rom/kernal.rom", 0);	
+	// character rom is copied, i/o is on top of it
+	if (!o->nrom) {
+		addRom (0xA000, "rom/basic.rom", 1);
+		addRom (0xD000, "rom/character.rom", 0);
+		addRom (0xE000, "rom/kernal.rom", 1);
+	}
+	for (int i = 0; i < o->nrom; i++) {
+		addRom (o->rom[i].address, o->rom[i].file, o->rom[i].shared);
+	}
 
 	// see https://github.com/Klaus2m5/6502_65C02_functional_tests
-	//cpu_addRom (0x0400, "rom/6502test.bin", 0);
+	//   --rom 0x0400:rom/6502test.bin --pc 0x0400
+	// see nestest https://wiki.nesdev.com/w/index.php/Emulator_tests
+	// http://www.qmtpro.com/~nes/misc/nestest.log
+	//   --map 0xC000:rom/nestest.nes --pc 0xC000 (or cpu_loadImage CPU_IMG_NES)
+
+	if (o->fastboot && (err = kernal_fastboot (o->fastboot)) != CPU_OK) {
+		printf ("fastboot %s: %s\n", o->fastboot, cpu_strerror (err));
+	}
+	if (o->traps && (err = kernal_traps (o->traps, stdout)) != CPU_OK) {
+		printf ("traps %s: %s\n", o->traps, cpu_strerror (err));
+	}
 
-// see nestest https://wiki.nesdev.com/w/index.php/Emulator_tests
-// http://www.qmtpro.com/~nes/misc/nestest.log
-//cpu_addRom (0xc000, "rom/nestest.nes", 0x10);
-	
 	cpu_reset ();
-	
-//cpu.PC= 0xc000;
 
-	cpu_run (); 
+	if (o->load && (err = loadState (o->load)) != STATE_OK) {
+		fprintf (stderr, "can't load snapshot %s (%d)\n", o->load, err);
+		return EXIT_FAILURE;
+	}
+
+	if (o->prg) {
+		if (kernal_isReady ()) {
+			err = kernal_loadPrg (o->prg, (o->pc >= 0 ? KERNAL_RUN_SYS : KERNAL_RUN_BASIC), (o->pc >= 0 ? o->pc : 0));
+		} else {
+			err = cpu_loadImage (o->prg, CPU_IMG_PRG, CPU_IMG_HEADER, 0, NULL, NULL);
+		}
+		if (err != CPU_OK) {
+			fprintf (stderr, "can't load %s: %s\n", o->prg, cpu_strerror (err));
+			return EXIT_FAILURE;
+		}
+	}
+	if (o->pc >= 0 && !(o->prg && kernal_isReady ())) cpu.PC = o->pc;
+
+	if (o->profile) profile_start ();
+	cpu_setPacing (o->pace);
+
+	if (o->gdb) {
+		// remote debug, "target remote :1234" from gdb. run untraced a frame at a time
+		if ((err = gdb_listen (o->gdb)) != CPU_OK) {
+			fprintf (stderr, "gdb %s: %s\n", o->gdb, cpu_strerror (err));
+			return EXIT_FAILURE;
+		}
+		while (gdb_poll () != GDB_KILL) cpu_exec (o->frame);
+		gdb_close ();
+	} else if (o->fuzz) {
+		status = fuzz (o, (o->cycles ? o->cycles : o->frame));
+	} else if (o->lanes) {
+		// a second of the machine's clock unless told otherwise
+		status = lanes (o, (o->cycles ? o->cycles : (uint64_t)o->freq));
+	} else {
+		uint64_t istr   = ((o->istr || o->cycles) ? o->istr : DEFAULT_ISTR);
+		uint64_t cycle0 = cpu.cycle;
+		double   t0     = now ();
+		uint64_t nist   = cpu_run (istr, o->cycles, o->trace);
 
+		// cost of the selected core, compare --core cycle against the default
+		if (o->stats == STATS_TEXT) {
+			printf ("%s core: %lu istr, %lu cycles in %.6fs\n", (o->core == CPU_CORE_CYCLE ? "cycle":"fast"),
+					(unsigned long)nist, (unsigned long)(cpu.cycle - cycle0), now () - t0);
+		}
+	}
+
+	if (o->stats == STATS_PROM) {
+		char text[4096];
+
+		stats_format (text, sizeof (text));
+		fputs (text, stdout);
+	}
+	if (o->profile) {
+		profile_stop ();
+		profile_report (stdout, 20);
+	}
+
+	err = status;
+	if (o->save && saveState (o->save) != CPU_OK) {
+		fprintf (stderr, "can't save snapshot %s\n", o->save);
+		err = EXIT_FAILURE;
+	}
+
+	if (o->daemon) {
+		// the machine as it is now, on to READY if there's a kernal, is the
+		// warm one: prg=, sys= and ready go through the kernal from there
+		// no SA_RESTART, wait() has to give up for daemon_stop to be seen
+		struct sigaction sa = { .sa_handler = onSignal };
+		int e;
+
+		if (kernal_runToReady ((uint64_t)o->freq * 10) != CPU_OK) {
+			printf ("daemon: not at READY, jobs start where the run stopped\n");
+		}
+		fflush (stdout);
+		sigaction (SIGINT, &sa, NULL);
+		sigaction (SIGTERM, &sa, NULL);
+		if ((e = daemon_serve (o->daemon, o->workers)) != CPU_OK) {
+			fprintf (stderr, "daemon %s: %s\n", o->daemon, cpu_strerror (e));
+			err = EXIT_FAILURE;
+		}
+	}
+
+	if (o->profile) profile_free ();
 	cpu_free ();
+	fflush (stdout);
+	return err;
+}
+
+// every line of the manifest is a job: its options on top of the command
+// line ones, # starts a comment. up to o->jobs processes at once, each builds
+// its own machine. the output of a job without -o is dropped
+static int
+batch (const struct opts *o)
+{
+	FILE *f = (strcmp (o->batch, "-") ? fopen (o->batch, "r") : stdin);
+	char  line[4096];
+	int   nline = 0, njob = 0, running = 0, failed = 0;
 
-	return 0;
+	struct {
+		pid_t  pid;
+		int    line;
+		double t0;
+	} job[MAXJOB];
+
+	if (!f) {
+		fprintf (stderr, "can't read %s\n", o->batch);
+		return EXIT_FAILURE;
+	}
+
+	for (;;) {
+		int more = (fgets (line, sizeof (line), f) != NULL);
+
+		// wait for a slot, or for everyone at the end
+		while (running && (running == o->jobs || !more)) {
+			int   status;
+			pid_t pid = wait (&status);
+
+			if (pid < 0) {
+				if (errno == EINTR) continue;
+				running = 0;
+				break;
+			}
+			for (int i = 0; i < running; i++) {
+				if (job[i].pid != pid) continue;
+
+				int code = (WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status));
+				printf ("job %d: exit %d in %.3fs\n", job[i].line, code, now () - job[i].t0);
+				failed += (code != 0);
+				job[i] = job[--running];
+				break;
+			}
+		}
+		if (!more) break;
+
+		nline++;
+		char *hash = strchr (line, '#');
+		if (hash) *hash = '\0';
+
+		char *argv[MAXARG + 1], *save;
+		int   argc = 0;
+
+		argv[argc++] = (char *)"job";
+		for (char *tok = strtok_r (line, " \t\r\n", &save); tok && argc < MAXARG; tok = strtok_r (NULL, " \t\r\n", &save)) {
+			argv[argc++] = tok;
+		}
+		argv[argc] = NULL;
+		if (argc == 1) continue;
+
+		struct opts jo = *o;
+
+		njob++;
+
+		jo.batch = NULL;
+		jo.daemon = NULL;
+		jo.gdb = NULL;
+		jo.output = NULL;
+		if (!parseArgs (&jo, argc, argv) || jo.batch || jo.daemon || jo.gdb) {
+			fprintf (stderr, "job %d: bad options\n", nline);
+			failed++;
+			continue;
+		}
+
+		double t0 = now ();
+
+		fflush (stdout);
+		pid_t pid = fork ();
+
+		if (pid < 0) {
+			fprintf (stderr, "job %d: can't fork\n", nline);
+			failed++;
+			continue;
+		}
+		if (pid == 0) {
+			if (!jo.output) jo.output = "/dev/null";
+			_exit (run (&jo));
+		}
+		job[running].pid  = pid;
+		job[running].line = nline;
+		job[running].t0   = t0;
+		running++;
+	}
+
+	if (f != stdin) fclose (f);
+	printf ("%d jobs, %d failed\n", njob, failed);
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+int
+main (int argc, char *argv[])
+{
+	struct opts o;
+
+	defaults (&o);
+	if (!parseArgs (&o, argc, argv)) {
+		usage (stderr);
+		return 2;
+	}
 
+	return (o.batch ? batch (&o) : run (&o));
+}
@@ -0,0 +1,82 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "cpu.h"
+#include "net.h"
+
+int
+net_listen (const char *where, int backlog, int flags, char *path, size_t len)
+{
+    char *end;
+    long port = strtol (where, &end, 10);
+    int one = 1;
+    int fd;
+
+    if (len) *path = '\0';
+
+    if ((flags & NET_TCP) && *where && !*end) {
+        if (port <= 0 || port > 0xFFFF) return CPU_ESIZE;
+
+        struct sockaddr_in sa;
+        memset (&sa, 0, sizeof (sa));
+        sa.sin_family      = AF_INET;
+        sa.sin_port        = htons (port);
+        sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+        if ((fd = socket (AF_INET, SOCK_STREAM, 0)) < 0) return CPU_EIO;
+        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+        if (bind (fd, (struct sockaddr *)&sa, sizeof (sa)) || listen (fd, backlog)) {
+            close (fd);
+            return CPU_EIO;
+        }
+    } else {
+        struct sockaddr_un sa;
+        if (strlen (where) >= sizeof (sa.sun_path) || strlen (where) >= len) return CPU_ESIZE;
+
+        memset (&sa, 0, sizeof (sa));
+        sa.sun_family = AF_UNIX;
+        strcpy (sa.sun_path, where);
+
+        if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0) return CPU_EIO;
+        unlink (where);
+        if (bind (fd, (struct sockaddr *)&sa, sizeof (sa)) || listen (fd, backlog)) {
+            close (fd);
+            return CPU_EIO;
+        }
+        strcpy (path, where);
+    }
+
+    if (flags & NET_NONBLOCK) fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+void
+net_close (int fd, char *path)
+{
+    if (fd >= 0) close (fd);
+
+    if (*path) unlink (path);
+    *path = '\0';
+}
@@ -0,0 +1,37 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+
+// listening sockets for the servers (gdb stub, metrics, daemon)
+//
+// where is "1234", a tcp port on 127.0.0.1 (with NET_TCP), or else a unix
+// socket path: a stale socket file there is replaced, path gets it back for
+// net_close to remove ("" for tcp)
+
+#define NET_TCP      1      // a number is a port
+#define NET_NONBLOCK 2      // accept doesn't wait
+
+// the socket, or a cpu_err
+extern int  net_listen (const char *where, int backlog, int flags, char *path, size_t len);
+
+// close fd (-1: none) and remove the unix socket file in path, if any
+extern void net_close  (int fd, char *path);
+
+#endif // NET_H
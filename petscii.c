@@ -0,0 +1,228 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cpu.h"
+#include "petscii.h"
+
+// https://www.c64-wiki.com/wiki/PETSCII
+// https://www.unicode.org/charts/PDF/U1FB00.pdf (Symbols for Legacy Computing)
+
+// uppercase / graphics set. control codes print nothing, but RETURN
+const char *const petscii_utf8[256] = {
+    "",           "",           "",           "",           "",           "",           "",           "",           // $00
+    "",           "",           "",           "",           "",           "\n",         "",           "",           // $08
+    "",           "",           "",           "",           "",           "",           "",           "",           // $10
+    "",           "",           "",           "",           "",           "",           "",           "",           // $18
+    " ",          "!",          "\"",         "#",          "$",          "%",          "&",          "'",          // $20
+    "(",          ")",          "*",          "+",          ",",          "-",          ".",          "/",          // $28
+    "0",          "1",          "2",          "3",          "4",          "5",          "6",          "7",          // $30
+    "8",          "9",          ":",          ";",          "<",          "=",          ">",          "?",          // $38
+    "@",          "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $40
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $48
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $50
+    "X",          "Y",          "Z",          "[",          "\u00A3",     "]",          "\u2191",     "\u2190",     // $58
+    "\u2500",     "\u2660",     "\U0001FB72", "\U0001FB78", "\U0001FB77", "\U0001FB76", "\U0001FB7A", "\U0001FB71", // $60
+    "\U0001FB74", "\u256E",     "\u2570",     "\u256F",     "\U0001FB7C", "\u2572",     "\u2571",     "\U0001FB7D", // $68
+    "\U0001FB7E", "\u25CF",     "\U0001FB7B", "\u2665",     "\U0001FB70", "\u256D",     "\u2573",     "\u25CB",     // $70
+    "\u2663",     "\U0001FB75", "\u2666",     "\u253C",     "\U0001FB8C", "\u2502",     "\u03C0",     "\u25E5",     // $78
+    "",           "",           "",           "",           "",           "",           "",           "",           // $80
+    "",           "",           "",           "",           "",           "\n",         "",           "",           // $88
+    "",           "",           "",           "",           "",           "",           "",           "",           // $90
+    "",           "",           "",           "",           "",           "",           "",           "",           // $98
+    "\u00A0",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $A0
+    "\U0001FB8F", "\u25E4",     "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $A8
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $B0
+    "\U0001FB83", "\u2583",     "\U0001FB7F", "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u259A",     // $B8
+    "\u2500",     "\u2660",     "\U0001FB72", "\U0001FB78", "\U0001FB77", "\U0001FB76", "\U0001FB7A", "\U0001FB71", // $C0
+    "\U0001FB74", "\u256E",     "\u2570",     "\u256F",     "\U0001FB7C", "\u2572",     "\u2571",     "\U0001FB7D", // $C8
+    "\U0001FB7E", "\u25CF",     "\U0001FB7B", "\u2665",     "\U0001FB70", "\u256D",     "\u2573",     "\u25CB",     // $D0
+    "\u2663",     "\U0001FB75", "\u2666",     "\u253C",     "\U0001FB8C", "\u2502",     "\u03C0",     "\u25E5",     // $D8
+    "\u00A0",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $E0
+    "\U0001FB8F", "\u25E4",     "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $E8
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $F0
+    "\U0001FB83", "\u2583",     "\U0001FB7F", "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u03C0"      // $F8
+};
+
+// lowercase / uppercase set (after CHR$(14)). only letters and a few glyphs differ
+const char *const petscii_utf8_lower[256] = {
+    "",           "",           "",           "",           "",           "",           "",           "",           // $00
+    "",           "",           "",           "",           "",           "\n",         "",           "",           // $08
+    "",           "",           "",           "",           "",           "",           "",           "",           // $10
+    "",           "",           "",           "",           "",           "",           "",           "",           // $18
+    " ",          "!",          "\"",         "#",          "$",          "%",          "&",          "'",          // $20
+    "(",          ")",          "*",          "+",          ",",          "-",          ".",          "/",          // $28
+    "0",          "1",          "2",          "3",          "4",          "5",          "6",          "7",          // $30
+    "8",          "9",          ":",          ";",          "<",          "=",          ">",          "?",          // $38
+    "@",          "a",          "b",          "c",          "d",          "e",          "f",          "g",          // $40
+    "h",          "i",          "j",          "k",          "l",          "m",          "n",          "o",          // $48
+    "p",          "q",          "r",          "s",          "t",          "u",          "v",          "w",          // $50
+    "x",          "y",          "z",          "[",          "\u00A3",     "]",          "\u2191",     "\u2190",     // $58
+    "\u2500",     "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $60
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $68
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $70
+    "X",          "Y",          "Z",          "\u253C",     "\U0001FB8C", "\u2502",     "\U0001FB96", "\U0001FB98", // $78
+    "",           "",           "",           "",           "",           "",           "",           "",           // $80
+    "",           "",           "",           "",           "",           "\n",         "",           "",           // $88
+    "",           "",           "",           "",           "",           "",           "",           "",           // $90
+    "",           "",           "",           "",           "",           "",           "",           "",           // $98
+    "\u00A0",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $A0
+    "\U0001FB8F", "\U0001FB99", "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $A8
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $B0
+    "\U0001FB83", "\u2583",     "\u2713",     "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u259A",     // $B8
+    "\u2500",     "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $C0
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $C8
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $D0
+    "X",          "Y",          "Z",          "\u253C",     "\U0001FB8C", "\u2502",     "\U0001FB96", "\U0001FB98", // $D8
+    "\u00A0",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $E0
+    "\U0001FB8F", "\U0001FB99", "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $E8
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $F0
+    "\U0001FB83", "\u2583",     "\u2713",     "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\U0001FB96"  // $F8
+};
+
+// screen codes, what sits in video ram. $80-$FF are the reverse video of $00-$7F:
+// same glyph, but reverse space becomes a full block
+const char *const screen_utf8[256] = {
+    "@",          "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $00
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $08
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $10
+    "X",          "Y",          "Z",          "[",          "\u00A3",     "]",          "\u2191",     "\u2190",     // $18
+    " ",          "!",          "\"",         "#",          "$",          "%",          "&",          "'",          // $20
+    "(",          ")",          "*",          "+",          ",",          "-",          ".",          "/",          // $28
+    "0",          "1",          "2",          "3",          "4",          "5",          "6",          "7",          // $30
+    "8",          "9",          ":",          ";",          "<",          "=",          ">",          "?",          // $38
+    "\u2500",     "\u2660",     "\U0001FB72", "\U0001FB78", "\U0001FB77", "\U0001FB76", "\U0001FB7A", "\U0001FB71", // $40
+    "\U0001FB74", "\u256E",     "\u2570",     "\u256F",     "\U0001FB7C", "\u2572",     "\u2571",     "\U0001FB7D", // $48
+    "\U0001FB7E", "\u25CF",     "\U0001FB7B", "\u2665",     "\U0001FB70", "\u256D",     "\u2573",     "\u25CB",     // $50
+    "\u2663",     "\U0001FB75", "\u2666",     "\u253C",     "\U0001FB8C", "\u2502",     "\u03C0",     "\u25E5",     // $58
+    "\u00A0",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $60
+    "\U0001FB8F", "\u25E4",     "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $68
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $70
+    "\U0001FB83", "\u2583",     "\U0001FB7F", "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u259A",     // $78
+    "@",          "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $80
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $88
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $90
+    "X",          "Y",          "Z",          "[",          "\u00A3",     "]",          "\u2191",     "\u2190",     // $98
+    "\u2588",     "!",          "\"",         "#",          "$",          "%",          "&",          "'",          // $A0
+    "(",          ")",          "*",          "+",          ",",          "-",          ".",          "/",          // $A8
+    "0",          "1",          "2",          "3",          "4",          "5",          "6",          "7",          // $B0
+    "8",          "9",          ":",          ";",          "<",          "=",          ">",          "?",          // $B8
+    "\u2500",     "\u2660",     "\U0001FB72", "\U0001FB78", "\U0001FB77", "\U0001FB76", "\U0001FB7A", "\U0001FB71", // $C0
+    "\U0001FB74", "\u256E",     "\u2570",     "\u256F",     "\U0001FB7C", "\u2572",     "\u2571",     "\U0001FB7D", // $C8
+    "\U0001FB7E", "\u25CF",     "\U0001FB7B", "\u2665",     "\U0001FB70", "\u256D",     "\u2573",     "\u25CB",     // $D0
+    "\u2663",     "\U0001FB75", "\u2666",     "\u253C",     "\U0001FB8C", "\u2502",     "\u03C0",     "\u25E5",     // $D8
+    "\u2588",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $E0
+    "\U0001FB8F", "\u25E4",     "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $E8
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $F0
+    "\U0001FB83", "\u2583",     "\U0001FB7F", "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u259A"      // $F8
+};
+
+const char *const screen_utf8_lower[256] = {
+    "@",          "a",          "b",          "c",          "d",          "e",          "f",          "g",          // $00
+    "h",          "i",          "j",          "k",          "l",          "m",          "n",          "o",          // $08
+    "p",          "q",          "r",          "s",          "t",          "u",          "v",          "w",          // $10
+    "x",          "y",          "z",          "[",          "\u00A3",     "]",          "\u2191",     "\u2190",     // $18
+    " ",          "!",          "\"",         "#",          "$",          "%",          "&",          "'",          // $20
+    "(",          ")",          "*",          "+",          ",",          "-",          ".",          "/",          // $28
+    "0",          "1",          "2",          "3",          "4",          "5",          "6",          "7",          // $30
+    "8",          "9",          ":",          ";",          "<",          "=",          ">",          "?",          // $38
+    "\u2500",     "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $40
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $48
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $50
+    "X",          "Y",          "Z",          "\u253C",     "\U0001FB8C", "\u2502",     "\U0001FB96", "\U0001FB98", // $58
+    "\u00A0",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $60
+    "\U0001FB8F", "\U0001FB99", "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $68
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $70
+    "\U0001FB83", "\u2583",     "\u2713",     "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u259A",     // $78
+    "@",          "a",          "b",          "c",          "d",          "e",          "f",          "g",          // $80
+    "h",          "i",          "j",          "k",          "l",          "m",          "n",          "o",          // $88
+    "p",          "q",          "r",          "s",          "t",          "u",          "v",          "w",          // $90
+    "x",          "y",          "z",          "[",          "\u00A3",     "]",          "\u2191",     "\u2190",     // $98
+    "\u2588",     "!",          "\"",         "#",          "$",          "%",          "&",          "'",          // $A0
+    "(",          ")",          "*",          "+",          ",",          "-",          ".",          "/",          // $A8
+    "0",          "1",          "2",          "3",          "4",          "5",          "6",          "7",          // $B0
+    "8",          "9",          ":",          ";",          "<",          "=",          ">",          "?",          // $B8
+    "\u2500",     "A",          "B",          "C",          "D",          "E",          "F",          "G",          // $C0
+    "H",          "I",          "J",          "K",          "L",          "M",          "N",          "O",          // $C8
+    "P",          "Q",          "R",          "S",          "T",          "U",          "V",          "W",          // $D0
+    "X",          "Y",          "Z",          "\u253C",     "\U0001FB8C", "\u2502",     "\U0001FB96", "\U0001FB98", // $D8
+    "\u2588",     "\u258C",     "\u2584",     "\u2594",     "\u2581",     "\u258F",     "\u2592",     "\u2595",     // $E0
+    "\U0001FB8F", "\U0001FB99", "\U0001FB87", "\u251C",     "\u2597",     "\u2514",     "\u2510",     "\u2582",     // $E8
+    "\u250C",     "\u2534",     "\u252C",     "\u2524",     "\u258E",     "\u258D",     "\U0001FB88", "\U0001FB82", // $F0
+    "\U0001FB83", "\u2583",     "\u2713",     "\u2596",     "\u259D",     "\u2518",     "\u2598",     "\u259A"      // $F8
+};
+
+// screen codes packed in a word, glyph bytes in memory order. built once,
+// whichever thread gets here first
+static uint32_t glyph[2][256];
+static uint8_t  glyphlen[2][256];
+static pthread_once_t glyphonce = PTHREAD_ONCE_INIT;
+
+static void
+petscii_glyphInit (void)
+{
+    for (int c = 0; c < 256; c++) {
+        glyphlen[0][c] = strlen (screen_utf8[c]);
+        glyphlen[1][c] = strlen (screen_utf8_lower[c]);
+        memcpy (&glyph[0][c], screen_utf8[c], glyphlen[0][c]);
+        memcpy (&glyph[1][c], screen_utf8_lower[c], glyphlen[1][c]);
+    }
+}
+
+#define HIBASE 0x0288
+#define VICMEM 0xD018
+
+size_t
+petscii_screen (char *buf, size_t len)
+{
+    if (len < PETSCII_SCREEN_MAX) return 0;
+    pthread_once (&glyphonce, petscii_glyphInit);
+
+    // before the kernal sets HIBASE, or if it points past the end, use $0400
+    uint32_t base = mem[HIBASE] << 8;
+    if (base == 0 || base + PETSCII_COLS * PETSCII_ROWS > CPU_MEMSIZE) base = 0x0400;
+
+    const uint8_t  *scr  = mem + base;
+    const uint32_t *g    = glyph[(mem[VICMEM] & 0x02) >> 1];
+    const uint8_t  *glen = glyphlen[(mem[VICMEM] & 0x02) >> 1];
+    char *p = buf;
+
+    for (int l = 0; l < PETSCII_ROWS; l++) {
+        // 8 screen codes at a time. $20-$3F are the same in ascii and in both
+        // sets, a run of them is copied as is
+        for (int c = 0; c < PETSCII_COLS; c += 8, scr += 8) {
+            uint64_t v;
+            memcpy (&v, scr, 8);
+            if ((v & 0xE0E0E0E0E0E0E0E0ULL) == 0x2020202020202020ULL) {
+                memcpy (p, &v, 8);
+                p += 8;
+                continue;
+            }
+            // always 4 bytes stored, the pointer moves by the glyph length
+            for (int i = 0; i < 8; i++) {
+                memcpy (p, &g[scr[i]], 4);
+                p += glen[scr[i]];
+            }
+        }
+        *p++ = '\n';
+    }
+    *p = '\0';
+
+    return p - buf;
+}
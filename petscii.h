@@ -0,0 +1,41 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef PETSCII_H
+#define PETSCII_H
+
+#include <stddef.h>
+
+// PETSCII to UTF-8, uppercase/graphics and lowercase/uppercase sets
+extern const char *const petscii_utf8[256];
+extern const char *const petscii_utf8_lower[256];
+
+// screen code to UTF-8, same two sets
+extern const char *const screen_utf8[256];
+extern const char *const screen_utf8_lower[256];
+
+// text screen, 40x25
+#define PETSCII_COLS 40
+#define PETSCII_ROWS 25
+
+// worst case of petscii_screen: 4 byte glyphs, a newline per row, the terminator
+#define PETSCII_SCREEN_MAX (PETSCII_ROWS * (PETSCII_COLS * 4 + 1) + 1)
+
+// the screen at (HIBASE) as UTF-8 rows, charset from $D018. buf must hold
+// PETSCII_SCREEN_MAX bytes. returns the length, 0 if buf is too short
+extern size_t petscii_screen (char *buf, size_t len);
+
+#endif // PETSCII_H
@@ -0,0 +1,332 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "disasm.h"
+#include "profile.h"
+
+// open addressing, twice the nodes so it never fills up
+#define HASHSIZE (PROFILE_MAXNODE * 2)
+
+// the 6510 stack holds at most 128 return addresses
+#define MAXDEPTH 128
+
+// out of the hash, never a routine of its own
+#define OVERFLOW (PROFILE_MAXNODE - 1)
+
+struct profile_node {
+    uint32_t parent;
+    uint16_t address;       // routine entry, JSR target
+    uint64_t calls;
+};
+
+struct profile_frame {
+    uint32_t node;          // caller
+    uint8_t  sp;            // SP before the JSR, RTS gets back here
+};
+
+uint8_t  profile_on;
+uint64_t profile_dropped;
+
+struct profile_count  profile_op[256];
+struct profile_count *profile_pc;
+
+static struct profile_node *nodes;
+static uint64_t            *self;       // cycles per node
+static uint32_t             node;       // where the cpu is now
+static uint64_t             since;      // cycle node got the cpu
+static uint32_t            *hash;
+static uint32_t             nnodes;
+
+static struct profile_frame stack[MAXDEPTH];
+static int                  depth;
+
+static const char *const mode_name[] = {
+    [CPU_AM_IMP]  = "",       [CPU_AM_ACC]  = "A",      [CPU_AM_IMM]  = "#",
+    [CPU_AM_ZP]   = "zp",     [CPU_AM_ZPX]  = "zp,X",   [CPU_AM_ZPY]  = "zp,Y",
+    [CPU_AM_ABS]  = "abs",    [CPU_AM_ABSX] = "abs,X",  [CPU_AM_ABSY] = "abs,Y",
+    [CPU_AM_IND]  = "(abs)",  [CPU_AM_INDX] = "(zp,X)", [CPU_AM_INDY] = "(zp),Y",
+    [CPU_AM_REL]  = "rel"
+};
+
+void
+profile_reset (void)
+{
+    memset (profile_op, 0, sizeof (profile_op));
+
+    if (profile_pc) {
+        memset (profile_pc, 0, CPU_MEMSIZE * sizeof (*profile_pc));
+        memset (self, 0, PROFILE_MAXNODE * sizeof (*self));
+        memset (hash, 0, HASHSIZE * sizeof (*hash));
+    }
+
+    // node 0 is the root, where the profile started
+    if (nodes) {
+        nodes[0].parent  = 0;
+        nodes[0].address = cpu.PC;
+        nodes[0].calls   = 1;
+
+        nodes[OVERFLOW].parent  = 0;
+        nodes[OVERFLOW].address = 0;
+        nodes[OVERFLOW].calls   = 0;
+    }
+    nnodes = 1;
+    profile_dropped = 0;
+    node   = 0;
+    since  = cpu.cycle;
+    depth  = 0;
+}
+
+int
+profile_start (void)
+{
+    if (!profile_pc) {
+        profile_pc   = calloc (CPU_MEMSIZE, sizeof (*profile_pc));
+        self         = calloc (PROFILE_MAXNODE, sizeof (*self));
+        nodes        = calloc (PROFILE_MAXNODE, sizeof (*nodes));
+        hash         = calloc (HASHSIZE, sizeof (*hash));
+
+        if (!profile_pc || !self || !nodes || !hash) {
+            profile_free ();
+            return CPU_ENOMEM;
+        }
+        profile_reset ();
+    }
+
+    since = cpu.cycle;
+    profile_on = 1;
+    return CPU_OK;
+}
+
+// charge the cycles since the last move to the current node
+static void
+profile_flush (void)
+{
+    if (self) self[node] += cpu.cycle - since;
+    since = cpu.cycle;
+}
+
+void
+profile_stop (void)
+{
+    if (profile_on) profile_flush ();
+    profile_on = 0;
+}
+
+void
+profile_free (void)
+{
+    profile_on = 0;
+
+    free (profile_pc);
+    free (self);
+    free (nodes);
+    free (hash);
+
+    profile_pc   = NULL;
+    self         = NULL;
+    nodes        = NULL;
+    hash         = NULL;
+}
+
+// child of parent for the routine at address, made up on first call. when the
+// tree is full a new one is the overflow node
+static uint32_t
+profile_child (uint32_t parent, uint16_t address)
+{
+    uint32_t h = ((parent * 0x9E3779B1u) ^ (address * 0x85EBCA6Bu)) & (HASHSIZE - 1);
+
+    for (;;) {
+        uint32_t n = hash[h];
+
+        if (n == 0) {
+            if (nnodes == OVERFLOW) {
+                profile_dropped++;
+                return OVERFLOW;
+            }
+
+            n = nnodes++;
+            nodes[n].parent  = parent;
+            nodes[n].address = address;
+            nodes[n].calls   = 0;
+            hash[h] = n + 1;
+            return n;
+        }
+        if (nodes[n - 1].parent == parent && nodes[n - 1].address == address) return n - 1;
+
+        h = (h + 1) & (HASHSIZE - 1);
+    }
+}
+
+// after the istruction: PC and SP are already the new ones
+void
+profile_call (uint8_t ir)
+{
+    profile_flush ();
+
+    if (ir == 0x20) {
+        if (depth == MAXDEPTH) return;
+
+        stack[depth].node = node;
+        stack[depth].sp   = cpu.SP + 2;
+        depth++;
+
+        node = profile_child (node, cpu.PC);
+        nodes[node].calls++;
+        return;
+    }
+
+    // RTS / RTI: drop every frame the stack pointer is back above. an RTS used
+    // as a jump (address pushed by hand) leaves SP below the frame, no return
+    while (depth && stack[depth - 1].sp <= cpu.SP) {
+        node = stack[--depth].node;
+    }
+}
+
+static const struct profile_count *sort_base;
+
+static int
+profile_cmp (const void *a, const void *b)
+{
+    uint64_t ca = sort_base[*(const uint32_t *)a].cycles;
+    uint64_t cb = sort_base[*(const uint32_t *)b].cycles;
+
+    return (ca < cb) - (ca > cb);
+}
+
+// indexes of the n entries with cycles, most expensive first. returns how many
+static uint32_t
+profile_sort (const struct profile_count *c, uint32_t n, uint32_t *idx)
+{
+    uint32_t m = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (c[i].cycles) idx[m++] = i;
+    }
+    sort_base = c;
+    qsort (idx, m, sizeof (*idx), profile_cmp);
+    return m;
+}
+
+static double
+percent (uint64_t part, uint64_t total)
+{
+    return (total ? 100.0 * part / total : 0.0);
+}
+
+void
+profile_report (FILE *out, int top)
+{
+    uint64_t total = 0;
+    char line[DISASM_LINE];
+
+    if (!profile_pc) return;
+    if (profile_on) profile_flush ();
+
+    uint32_t *idx = malloc (CPU_MEMSIZE * sizeof (*idx));
+    struct profile_count *routine = calloc (CPU_MEMSIZE, sizeof (*routine));
+    if (!idx || !routine) {
+        free (idx);
+        free (routine);
+        return;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        total += profile_op[i].cycles;
+    }
+
+    uint32_t n = profile_sort (profile_op, 256, idx);
+    if (top && n > (uint32_t)top) n = top;
+
+    fprintf (out, "opcodes by cycles, %lu total\n", (unsigned long)total);
+    fprintf (out, "%14s %7s %14s  opcode\n", "cycles", "%", "count");
+    for (uint32_t i = 0; i < n; i++) {
+        const struct isa_t *isa = &ISA[idx[i]];
+        fprintf (out, "%14lu %6.2f%% %14lu  $%02X %.3s %s\n",
+                 (unsigned long)profile_op[idx[i]].cycles, percent (profile_op[idx[i]].cycles, total),
+                 (unsigned long)profile_op[idx[i]].count, idx[i], isa->opcode, mode_name[isa->mode]);
+    }
+
+    n = profile_sort (profile_pc, CPU_MEMSIZE, idx);
+    if (top && n > (uint32_t)top) n = top;
+
+    fprintf (out, "\nistructions by cycles\n");
+    fprintf (out, "%14s %7s %14s  istruction\n", "cycles", "%", "count");
+    for (uint32_t i = 0; i < n; i++) {
+        disasm_one (idx[i], DISASM_ADDR, line, sizeof (line));
+        fprintf (out, "%14lu %6.2f%% %14lu  %s\n",
+                 (unsigned long)profile_pc[idx[i]].cycles, percent (profile_pc[idx[i]].cycles, total),
+                 (unsigned long)profile_pc[idx[i]].count, line);
+    }
+
+    // a routine is every node with its entry address, whoever the caller
+    for (uint32_t i = 0; i < nnodes; i++) {
+        routine[nodes[i].address].cycles += self[i];
+        routine[nodes[i].address].count  += nodes[i].calls;
+    }
+
+    n = profile_sort (routine, CPU_MEMSIZE, idx);
+    if (top && n > (uint32_t)top) n = top;
+
+    fprintf (out, "\nroutines by self cycles\n");
+    fprintf (out, "%14s %7s %14s  entry\n", "cycles", "%", "calls");
+    for (uint32_t i = 0; i < n; i++) {
+        fprintf (out, "%14lu %6.2f%% %14lu  $%04X\n",
+                 (unsigned long)routine[idx[i]].cycles, percent (routine[idx[i]].cycles, total),
+                 (unsigned long)routine[idx[i]].count, idx[i]);
+    }
+    if (profile_dropped) {
+        fprintf (out, "%14lu %6.2f%% %14lu  overflow, %lu calls with the %d nodes in use\n",
+                 (unsigned long)self[OVERFLOW], percent (self[OVERFLOW], total),
+                 (unsigned long)nodes[OVERFLOW].calls, (unsigned long)profile_dropped, PROFILE_MAXNODE);
+    }
+
+    free (idx);
+    free (routine);
+}
+
+// one line per call path: root;$E394;$FD50 cycles
+int
+profile_folded (FILE *out)
+{
+    uint32_t path[MAXDEPTH];
+
+    if (!profile_pc) return CPU_ESTATE;
+    if (profile_on) profile_flush ();
+
+    for (uint32_t i = 0; i < nnodes; i++) {
+        if (!self[i]) continue;
+
+        int d = 0;
+        for (uint32_t n = i; n && d < MAXDEPTH; n = nodes[n].parent) {
+            path[d++] = n;
+        }
+
+        fprintf (out, "$%04X", nodes[0].address);
+        while (d--) {
+            fprintf (out, ";$%04X", nodes[path[d]].address);
+        }
+        if (fprintf (out, " %lu\n", (unsigned long)self[i]) < 0) return CPU_EIO;
+    }
+    if (self[OVERFLOW] && fprintf (out, "$%04X;overflow %lu\n", nodes[0].address, (unsigned long)self[OVERFLOW]) < 0) {
+        return CPU_EIO;
+    }
+    return CPU_OK;
+}
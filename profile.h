@@ -0,0 +1,70 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// execution profiler
+//
+// counts istructions and cycles per opcode and per PC, and charges cycles to
+// a call tree built from JSR/RTS. the cpu calls profile_istr after every
+// istruction while profile_on is set, the tree is only touched on JSR, RTS
+// and RTI: a node gets the cycles spent since the last move.
+// the report is sorted by cycles, the folded output is for flamegraph.pl
+// https://github.com/brendangregg/FlameGraph
+
+// call tree nodes. past that a new call path is charged to one overflow node
+// (the last one, under the root), profile_dropped counts those calls
+#define PROFILE_MAXNODE 65536
+
+struct profile_count {
+	uint64_t count;
+	uint64_t cycles;
+};
+
+extern uint8_t  profile_on;
+extern uint64_t profile_dropped;
+
+extern struct profile_count  profile_op[256];
+extern struct profile_count *profile_pc;        // CPU_MEMSIZE entries
+
+extern int  profile_start (void);
+extern void profile_stop  (void);
+extern void profile_reset (void);
+extern void profile_free  (void);
+
+// top: lines per section, 0 for all
+extern void profile_report (FILE *out, int top);
+extern int  profile_folded (FILE *out);
+
+extern void profile_call (uint8_t ir);
+
+static inline void
+profile_istr (uint16_t pc, uint8_t ir, uint32_t cycles)
+{
+	profile_op[ir].count++;
+	profile_op[ir].cycles += cycles;
+	profile_pc[pc].count++;
+	profile_pc[pc].cycles += cycles;
+
+	// JSR, RTS, RTI move in the call tree
+	if (ir == 0x20 || ir == 0x60 || ir == 0x40) profile_call (ir);
+}
+
+#endif // PROFILE_H
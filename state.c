@@ -0,0 +1,355 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "state.h"
+
+#define STATE_HEADER 35
+#define STATE_ROM    14
+
+static inline uint8_t *
+put16 (uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t *
+put32 (uint8_t *p, uint32_t v)
+{
+    p = put16 (p, v);
+    return put16 (p, v >> 16);
+}
+
+static inline uint8_t *
+put64 (uint8_t *p, uint64_t v)
+{
+    p = put32 (p, v);
+    return put32 (p, v >> 32);
+}
+
+static inline uint16_t
+get16 (const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t
+get32 (const uint8_t *p)
+{
+    return get16 (p) | ((uint32_t)get16 (p + 2) << 16);
+}
+
+static inline uint64_t
+get64 (const uint8_t *p)
+{
+    return get32 (p) | ((uint64_t)get32 (p + 4) << 32);
+}
+
+size_t
+state_size (void)
+{
+    return STATE_HEADER + cpu_nroms * STATE_ROM + CPU_MEMSIZE;
+}
+
+// return the snapshot size or a negative state_err
+int
+state_save (uint8_t *buf, size_t len)
+{
+    if (len < state_size ()) return STATE_ESIZE;
+
+    uint8_t *p = buf;
+
+    memcpy (p, STATE_MAGIC, 8);
+    p = put16 (p + 8, STATE_VERSION);
+    p = put16 (p, cpu.PC);
+
+    *p++ = cpu.A;
+    *p++ = cpu.X;
+    *p++ = cpu.Y;
+    *p++ = cpu.SP;
+    *p++ = cpu.P.P;
+    *p++ = cpu.IR;
+    *p++ = cpu.tcycle;
+    *p++ = cpu.ptr;
+    *p++ = cpu.data;
+    *p++ = cpu.carry;
+    p = put16 (p, cpu.ea);
+    *p++ = cpu.irq;
+    *p++ = cpu.intr;
+
+    p = put64 (p, cpu.cycle);
+
+    *p++ = cpu_nroms;
+    for (int i = 0; i < cpu_nroms; i++) {
+        p = put16 (p, cpu_roms[i].address);
+        p = put32 (p, cpu_roms[i].len);
+        p = put64 (p, cpu_roms[i].hash);
+    }
+
+    memcpy (p, mem, CPU_MEMSIZE);
+    p += CPU_MEMSIZE;
+
+    return p - buf;
+}
+
+// the machine is untouched unless STATE_OK is returned
+int
+state_load (const uint8_t *buf, size_t len)
+{
+    if (len < STATE_HEADER) return STATE_ESIZE;
+    if (memcmp (buf, STATE_MAGIC, 8) != 0) return STATE_EMAGIC;
+    if (get16 (buf + 8) != STATE_VERSION) return STATE_EVERSION;
+
+    int nroms = buf[34];
+    const uint8_t *p = buf + STATE_HEADER;
+
+    if (len < (size_t)(STATE_HEADER + nroms * STATE_ROM + CPU_MEMSIZE)) return STATE_ESIZE;
+
+    // same rom set, same content
+    if (nroms != cpu_nroms) return STATE_EROM;
+    for (int i = 0; i < nroms; i++, p += STATE_ROM) {
+        int r;
+        for (r = 0; r < cpu_nroms; r++) {
+            if (cpu_roms[r].address == get16 (p) &&
+                cpu_roms[r].len     == get32 (p + 2) &&
+                cpu_roms[r].hash    == get64 (p + 6)) break;
+        }
+        if (r == cpu_nroms) return STATE_EROM;
+    }
+
+    cpu.PC     = get16 (buf + 10);
+    cpu.A      = buf[12];
+    cpu.X      = buf[13];
+    cpu.Y      = buf[14];
+    cpu.SP     = buf[15];
+    cpu.P.P    = buf[16];
+    cpu.IR     = buf[17];
+    cpu.tcycle = buf[18];
+    cpu.ptr    = buf[19];
+    cpu.data   = buf[20];
+    cpu.carry  = buf[21];
+    cpu.ea     = get16 (buf + 22);
+    cpu.irq    = buf[24];
+    cpu.intr   = buf[25];
+    cpu.cycle  = get64 (buf + 26);
+
+    cpu_memLoad (p);
+
+    return STATE_OK;
+}
+
+uint64_t
+state_digest (void)
+{
+    uint8_t regs[16];
+
+    put16 (regs, cpu.PC);
+    regs[2] = cpu.A;
+    regs[3] = cpu.X;
+    regs[4] = cpu.Y;
+    regs[5] = cpu.SP;
+    regs[6] = cpu.P.P;
+    regs[7] = cpu.tcycle;
+    put64 (regs + 8, cpu.cycle);
+
+    return cpu_hash (mem, CPU_MEMSIZE, cpu_hash (regs, sizeof (regs), 0));
+}
+
+pid_t
+state_fork (void)
+{
+    // don't let the child flush the parent's pending output again
+    fflush (stdout);
+    fflush (stderr);
+
+    return fork ();
+}
+
+// rewind ring
+
+#define PAGES (CPU_MEMSIZE >> 8)
+
+struct rewind_frame {
+    struct Tcpu cpu;
+    uint8_t     key;      // data is the whole memory
+    uint16_t    npages;   // else npages * (page number, 256 bytes)
+    uint8_t    *data;
+};
+
+static struct rewind_frame *ring;
+static unsigned ring_size;
+static unsigned ring_head;     // next slot to write
+static unsigned ring_count;
+static unsigned key_every;
+static unsigned key_wait;      // captures left before the next keyframe
+static size_t   ring_bytes;
+
+// i-th frame, oldest first
+#define FRAME(i) (&ring[(ring_head + ring_size - ring_count + (i)) % ring_size])
+
+int
+state_rewindInit (unsigned frames, unsigned keyevery)
+{
+    state_rewindFree ();
+
+    if (!frames || !keyevery) return STATE_ERANGE;
+
+    // struct Tcpu is cache line aligned, calloc doesn't go that far
+    ring = aligned_alloc (_Alignof (struct rewind_frame), frames * sizeof (struct rewind_frame));
+    if (!ring) return STATE_ENOMEM;
+    memset (ring, 0, frames * sizeof (struct rewind_frame));
+
+    ring_size  = frames;
+    key_every  = keyevery;
+    key_wait   = 0;
+    ring_head  = 0;
+    ring_count = 0;
+    ring_bytes = 0;
+
+    return STATE_OK;
+}
+
+static void
+rewind_drop (struct rewind_frame *f)
+{
+    if (!f->data) return;
+
+    ring_bytes -= (f->key ? CPU_MEMSIZE : f->npages * 257);
+    free (f->data);
+    f->data = NULL;
+}
+
+void
+state_rewindFree (void)
+{
+    for (unsigned i = 0; i < ring_size; i++) {
+        rewind_drop (&ring[i]);
+    }
+    free (ring);
+    ring       = NULL;
+    ring_size  = 0;
+    ring_count = 0;
+}
+
+int
+state_rewindCapture (void)
+{
+    if (!ring) return STATE_ERANGE;
+
+    struct rewind_frame *f = &ring[ring_head];
+    rewind_drop (f);
+
+    f->cpu = cpu;
+
+    if (key_wait == 0) {
+        f->data = malloc (CPU_MEMSIZE);
+        if (!f->data) return STATE_ENOMEM;
+
+        memcpy (f->data, mem, CPU_MEMSIZE);
+        f->key     = 1;
+        f->npages  = PAGES;
+        key_wait   = key_every;
+        ring_bytes += CPU_MEMSIZE;
+    } else {
+        int n = 0;
+        for (int p = 0; p < PAGES; p++) {
+            n += mem_dirty[p];
+        }
+
+        f->data = malloc (n * 257 + 1);
+        if (!f->data) return STATE_ENOMEM;
+
+        uint8_t *d = f->data;
+        for (int p = 0; p < PAGES; p++) {
+            if (!mem_dirty[p]) continue;
+            *d++ = p;
+            memcpy (d, &mem[p << 8], 256);
+            d += 256;
+        }
+        f->key     = 0;
+        f->npages  = n;
+        ring_bytes += n * 257;
+    }
+    key_wait--;
+
+    memset (mem_dirty, 0, PAGES);
+
+    ring_head = (ring_head + 1) % ring_size;
+    if (ring_count < ring_size) ring_count++;
+
+    return STATE_OK;
+}
+
+size_t
+state_rewindBytes (void)
+{
+    return ring_bytes + ring_size * sizeof (struct rewind_frame);
+}
+
+int
+state_seek (uint64_t cycle)
+{
+    int f, k;
+
+    if (!ring) return STATE_ERANGE;
+
+    for (f = ring_count - 1; f >= 0; f--) {
+        if (FRAME (f)->cpu.cycle <= cycle) break;
+    }
+    for (k = f; k >= 0; k--) {
+        if (FRAME (k)->key) break;
+    }
+    // the keyframe in front of it may have been overwritten already
+    if (f < 0 || k < 0) return STATE_ERANGE;
+
+    cpu_memLoad (FRAME (k)->data);
+    for (int i = k + 1; i <= f; i++) {
+        const uint8_t *d = FRAME (i)->data;
+        for (int n = 0; n < FRAME (i)->npages; n++, d += 257) {
+            if (!mem_rom[d[0]]) memcpy (&mem[d[0] << 8], d + 1, 256);
+        }
+    }
+    cpu = FRAME (f)->cpu;
+
+    // from here on the history is going to be different
+    for (unsigned i = f + 1; i < ring_count; i++) {
+        rewind_drop (FRAME (i));
+    }
+    ring_head  = (ring_head + ring_size - ring_count + f + 1) % ring_size;
+    ring_count = f + 1;
+
+    // the restore itself wrote pages that are not marked, start over with a keyframe
+    key_wait = 0;
+
+    if (cycle > cpu.cycle) {
+        cpu_exec (cycle - cpu.cycle);
+    }
+
+    return STATE_OK;
+}
+
+int
+state_rewind (uint64_t cycles)
+{
+    return state_seek (cycles < cpu.cycle ? cpu.cycle - cycles : 0);
+}
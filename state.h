@@ -0,0 +1,80 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// machine snapshot
+//
+//  0  "C6510SNP"               magic
+//  8  version                  u16
+// 10  PC                       u16
+// 12  A X Y SP P IR            u8 * 6
+// 18  tcycle ptr data carry    u8 * 4
+// 22  ea                       u16
+// 24  irq intr                 u8 * 2
+// 26  cycle                    u64
+// 34  nroms                    u8
+// 35  address len hash         (u16 u32 u64) * nroms
+// ..  memory                   64 KiB (ram and i/o, rom bytes included as mapped)
+//
+// all values little endian. roms are checked by hash on load, never stored.
+
+#define STATE_MAGIC   "C6510SNP"
+#define STATE_VERSION 2
+
+enum state_err {
+	STATE_OK       =  0,
+	STATE_ESIZE    = -1,   // buffer too small or truncated
+	STATE_EMAGIC   = -2,   // not a snapshot
+	STATE_EVERSION = -3,   // unsupported version
+	STATE_EROM     = -4,   // loaded roms differ from the snapshot ones
+	STATE_ENOMEM   = -5,   // out of memory
+	STATE_ERANGE   = -6    // cycle not in the rewind history
+};
+
+extern size_t state_size (void);
+extern int    state_save (uint8_t *buf, size_t len);
+extern int    state_load (const uint8_t *buf, size_t len);
+
+// hash of registers, cycle and memory: equal digests, same machine
+extern uint64_t state_digest (void);
+
+// clone the running machine: the child gets an identical machine and shares
+// every memory page with the parent until one of them writes it (copy on write).
+// same return as fork: 0 in the child, child pid in the parent, -1 on error
+extern pid_t  state_fork (void);
+
+// rewind ring
+// 'frames' captures of history, a full keyframe every 'keyevery' captures, the
+// ones in between only hold the 256 byte pages written since the previous
+// capture (see cpu_write). call state_rewindCapture once per video frame.
+// PAL, 60 seconds, a keyframe per second: state_rewindInit (3000, 50)
+extern int    state_rewindInit    (unsigned frames, unsigned keyevery);
+extern void   state_rewindFree    (void);
+extern int    state_rewindCapture (void);
+extern size_t state_rewindBytes   (void);
+
+// restore the newest capture not after 'cycle' (keyframe + deltas), then run
+// forward up to 'cycle'. the history after that point is dropped
+extern int    state_seek   (uint64_t cycle);
+extern int    state_rewind (uint64_t cycles);
+
+#endif // STATE_H
@@ -0,0 +1,205 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cpu.h"
+#include "net.h"
+#include "stats.h"
+
+// a client gets this long to send its request. stats_poll never waits for it,
+// a request not there yet is answered by a later call
+#define REQUEST_MS 100
+#define MAXCLIENT  8
+
+struct stats_slot {
+    struct stats s;
+} __attribute__ ((aligned (64)));
+
+static struct stats_slot slots[STATS_MAXTHREAD];
+static int nslots;
+
+static _Thread_local struct stats *local;
+
+static int lfd = -1;
+static char unix_path[sizeof (((struct sockaddr_un *)0)->sun_path)];
+
+static struct {
+    int      fd;
+    uint64_t due;       // monotonic ns, dropped unanswered after
+} clients[MAXCLIENT];
+static int nclients;
+
+// past STATS_MAXTHREAD threads share the last slot, the adds are atomic anyway
+struct stats *
+stats_thread (void)
+{
+    if (!local) {
+        int n = __atomic_fetch_add (&nslots, 1, __ATOMIC_RELAXED);
+        local = &slots[n < STATS_MAXTHREAD ? n : STATS_MAXTHREAD - 1].s;
+    }
+    return local;
+}
+
+void
+stats_get (struct stats *out)
+{
+    int n = __atomic_load_n (&nslots, __ATOMIC_RELAXED);
+    if (n > STATS_MAXTHREAD) n = STATS_MAXTHREAD;
+
+    memset (out, 0, sizeof (*out));
+    for (int i = 0; i < n; i++) {
+        const struct stats *s = &slots[i].s;
+        out->istr       += __atomic_load_n (&s->istr, __ATOMIC_RELAXED);
+        out->cycles     += __atomic_load_n (&s->cycles, __ATOMIC_RELAXED);
+        out->irq        += __atomic_load_n (&s->irq, __ATOMIC_RELAXED);
+        out->fixme      += __atomic_load_n (&s->fixme, __ATOMIC_RELAXED);
+        out->run_ns     += __atomic_load_n (&s->run_ns, __ATOMIC_RELAXED);
+        out->sleep_ns   += __atomic_load_n (&s->sleep_ns, __ATOMIC_RELAXED);
+        out->overrun_ns += __atomic_load_n (&s->overrun_ns, __ATOMIC_RELAXED);
+    }
+}
+
+void
+stats_reset (void)
+{
+    for (int i = 0; i < STATS_MAXTHREAD; i++) {
+        struct stats *s = &slots[i].s;
+        __atomic_store_n (&s->istr, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&s->cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&s->irq, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&s->fixme, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&s->run_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&s->sleep_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n (&s->overrun_ns, 0, __ATOMIC_RELAXED);
+    }
+}
+
+double
+stats_ratio (const struct stats *s)
+{
+    if (!s->run_ns || !cpu_freq) return 0.0;
+    return (s->cycles / cpu_freq) / (s->run_ns / 1e9);
+}
+
+size_t
+stats_format (char *buf, size_t len)
+{
+    struct stats s;
+    stats_get (&s);
+
+    const struct {
+        const char *name;
+        const char *type;
+        const char *help;
+        double      value;
+    } m[] = {
+        { "c6510_instructions_total",           "counter", "Istructions retired.",             s.istr },
+        { "c6510_cycles_total",                 "counter", "Cpu cycles.",                      s.cycles },
+        { "c6510_interrupts_total",             "counter", "Interrupts taken.",                s.irq },
+        { "c6510_fixme_total",                  "counter", "Unimplemented opcode hits.",       s.fixme },
+        { "c6510_run_seconds_total",            "counter", "Wall time spent running the cpu.", s.run_ns / 1e9 },
+        { "c6510_pacing_sleep_seconds_total",   "counter", "Time slept to hold real speed.",   s.sleep_ns / 1e9 },
+        { "c6510_pacing_overrun_seconds_total", "counter", "Time lost behind real speed.",     s.overrun_ns / 1e9 },
+        { "c6510_speed_ratio",                  "gauge",   "Emulated time over wall time.",    stats_ratio (&s) },
+    };
+
+    size_t n = 0;
+    for (unsigned i = 0; i < sizeof (m) / sizeof (*m); i++) {
+        n += snprintf (buf + (n < len ? n : len), (n < len ? len - n : 0),
+                       "# HELP %s %s\n# TYPE %s %s\n%s %.15g\n",
+                       m[i].name, m[i].help, m[i].name, m[i].type, m[i].name, m[i].value);
+    }
+    return n;
+}
+
+int
+stats_listen (const char *where)
+{
+    stats_close ();
+
+    int fd = net_listen (where, 8, NET_TCP | NET_NONBLOCK, unix_path, sizeof (unix_path));
+    if (fd < 0) return fd;
+
+    lfd = fd;
+    return CPU_OK;
+}
+
+void
+stats_close (void)
+{
+    while (nclients) {
+        close (clients[--nclients].fd);
+    }
+
+    net_close (lfd, unix_path);
+    lfd = -1;
+}
+
+static uint64_t
+stats_nsec (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// whatever the request, the answer is the metrics page
+void
+stats_poll (void)
+{
+    static const char head[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+    char req[1024], body[2048];
+    int cfd;
+
+    if (lfd < 0) return;
+
+    uint64_t now = stats_nsec ();
+
+    while (nclients < MAXCLIENT && (cfd = accept (lfd, NULL, NULL)) >= 0) {
+        clients[nclients].fd  = cfd;
+        clients[nclients].due = now + REQUEST_MS * 1000000ull;
+        nclients++;
+    }
+
+    for (int i = 0; i < nclients; ) {
+        ssize_t r = recv (clients[i].fd, req, sizeof (req), MSG_DONTWAIT);
+
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && now < clients[i].due) {
+            i++;
+            continue;
+        }
+
+        if (r > 0) {
+            size_t n = stats_format (body, sizeof (body));
+            if (n >= sizeof (body)) n = sizeof (body) - 1;
+
+            if (send (clients[i].fd, head, sizeof (head) - 1, MSG_NOSIGNAL) == (ssize_t)(sizeof (head) - 1)) {
+                send (clients[i].fd, body, n, MSG_NOSIGNAL);
+            }
+        }
+        close (clients[i].fd);
+        clients[i] = clients[--nclients];
+    }
+}
@@ -0,0 +1,68 @@
+//  Copyright (C) 2020  strippato@gmail.com
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// emulator counters
+//
+// every thread bumps its own cache line (no sharing, no locks), added in
+// bulk at the end of a cpu_exec / cpu_run, not per istruction. stats_get sums
+// all threads on demand.
+// stats_listen serves them as prometheus text over http, on a loopback tcp
+// port or a unix socket (curl --unix-socket)
+// https://prometheus.io/docs/instrumenting/exposition_formats/
+
+#define STATS_MAXTHREAD 64
+
+struct stats {
+	uint64_t istr;          // istructions retired
+	uint64_t cycles;
+	uint64_t irq;           // interrupts taken
+	uint64_t fixme;         // cpu_FIXME hits
+	uint64_t run_ns;        // wall time inside cpu_exec / cpu_run
+	uint64_t sleep_ns;      // pacing: ahead of real time, slept
+	uint64_t overrun_ns;    // pacing: behind real time, dropped
+};
+
+// this thread's counters, bump with stats_add
+extern struct stats *stats_thread (void);
+
+static inline void
+stats_add (uint64_t *counter, uint64_t n)
+{
+	__atomic_fetch_add (counter, n, __ATOMIC_RELAXED);
+}
+
+extern void   stats_get   (struct stats *out);
+extern void   stats_reset (void);
+
+// emulated time / wall time, 1.0 is real speed
+extern double stats_ratio (const struct stats *s);
+
+// prometheus text, returns its length (snprintf style)
+extern size_t stats_format (char *buf, size_t len);
+
+// "9100" is a tcp port on 127.0.0.1, anything else a unix socket path.
+// stats_poll answers the clients whose request is in, never blocks
+extern int  stats_listen (const char *where);
+extern void stats_poll   (void);
+extern void stats_close  (void);
+
+#endif // STATS_H